@@ -0,0 +1,3150 @@
+/****
+ *
+ * SFTP transfer library, used by the SFTP_Client program and embeddable in other programs (see SFTP_Transfer.h for the API).
+ * every function gets the context of its transfer (sftpTransfer_t), there is no global state except the libssh2 and winsock
+ * initialization (initTransferLibrary), so each context could run in its own thread.
+ *
+ * how a run works:
+ * 1. connect: prepare tcp/ip socket, create SSH session, handshake, authenticate and establish the SFTP session
+ *    (for the relay SSH remote device too in relay mode, for each SSH remote device in fan-out upload)
+ * 2. verify the transfer options and get the source path type
+ * 3. start the walk of the source path (files and directories), the walk feeds a bounded queue
+ * 4. create the destination path if not exist
+ * 5. transfer files and create directories (upload/download file and directory) as soon as the walk finds them,
+ *    with the progress and completion callbacks of the context
+ * 6. sync and rename the last files (batch durability mode)
+ * the connection stays open after the run, so another run could use it with other source and destination paths.
+ *
+*****/
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // for syncfs
+#endif
+#include "SFTP_Transfer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h> // for the log messages
+#include <unistd.h>
+#include <string.h>
+#include <time.h> // for the modification time filter
+#include <sys/time.h> // for gettimeofday (run stats)
+#include <sys/stat.h> // this works for me even in windows because i'm using mingw. for other solution use findfirstfile technique
+#include <dirent.h> // this works for me even in windows because i'm using mingw. for other solution use findfirstfile technique
+#ifdef WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <io.h> // for _setmode
+#include <fcntl.h> // for _O_BINARY
+// linux headers is not complited
+#elif UNIX || LINUX
+#include <sys/stat.h>
+#include <dirent.h>
+#endif
+
+// enable/disable trace function for debugging 
+#define LIBSSH2DEBUG
+
+// size of one block of data read/written in one call during a transfer
+#define TRANSFER_CHUNK_SIZE (32*1024)
+// number of blocks in the relay buffer ring (data in flight between the two SSH remote devices)
+#define RELAY_RING_SLOTS 8
+
+/*
+ * durability modes (durabilityMode)
+ *  + none: files are written in place and never synced (the data could be lost if the destination device crashes)
+ *  + batch: files are written with a temporary name (TEMPORARY_FILE_SUFFIX) and kept open. every DURABILITY_BATCH_FILES files
+ *    (checkpoint) and at the end of the transfer, they are synced all together then renamed in place, so a file is either the old one or the complete new one.
+ *    SFTP version 3 servers (OpenSSH) can't replace a file with a rename: the old remote file is removed then the new one is renamed,
+ *    which is not atomic (a crash between the two leaves only the complete new file with its temporary name).
+ *    in linux one syncfs syncs all the local files of the checkpoint, otherwise each file is synced.
+ *  + strict: each file is synced before it's closed.
+ * the remote sync uses the fsync@openssh.com extension. if the SSH remote server doesn't support it, the files are not synced (warning).
+ */
+#define DURABILITY_BATCH_FILES 64
+#define TEMPORARY_FILE_SUFFIX ".part"
+/*
+ * dedup mode (dedupMode, upload only): the local files are hashed during the walk and each content is uploaded once.
+ * a file with the same size and hash as a file already uploaded (and the same bytes, checked locally) is created in the SSH remote device from the first copy:
+ *  + hardlink: hard link with "ln" over an exec channel (libssh2 has no API for the hardlink@openssh.com extension)
+ *  + symlink: symbolic link with libssh2_sftp_symlink
+ *  + reflink: copy with "cp --reflink=auto" over an exec channel (no data over the network, shared blocks if the file system supports it)
+ * if the remote operation fails, the file is uploaded.
+ */
+// smaller files are cheaper to upload than to create from a copy
+#define DEDUP_MIN_SIZE 4096
+#define DEDUP_TABLE_SIZE 4096
+#ifdef WIN32
+static WSADATA myWSAData;
+#endif
+
+void logTransfer(sftpTransfer_t *transfer, const char *format, ...){
+    char message[4096];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    if(transfer->logCallback==NULL){
+        printf("%s", message);
+        return;
+    }
+    // the messages are built in pieces, the callback gets whole lines
+    char *messagePos;
+    for(messagePos=message; *messagePos!='\0'; messagePos++){
+        if(*messagePos=='\n' || transfer->logLineLength==(int)sizeof(transfer->logLine)-1){
+            transfer->logLine[transfer->logLineLength] = '\0';
+            transfer->logCallback(transfer, transfer->logLine, transfer->userData);
+            transfer->logLineLength = 0;
+            if(*messagePos=='\n'){
+                continue;
+            }
+        }
+        transfer->logLine[transfer->logLineLength++] = *messagePos;
+    }
+}
+
+// libssh2 trace messages of a session go to the log of its transfer
+static void traceTransfer(LIBSSH2_SESSION *session, void *context, const char *data, size_t length){
+    (void)session;
+    logTransfer((sftpTransfer_t*)context, "%.*s\n", (int)length, data);
+}
+
+// time in seconds
+static double getTime(){
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec/1000000.0;
+}
+
+// data of the current file written so far, for the progress callback
+static void reportProgress(sftpTransfer_t *transfer, char *source, char *destination, long long transferredBytes, long long totalBytes){
+    if(transfer->progressCallback!=NULL){
+        transfer->progressCallback(transfer, source, destination, transferredBytes, totalBytes, transfer->userData);
+    }
+}
+
+// file or directory done, for the completion callback
+static void reportCompletion(sftpTransfer_t *transfer, char *source, char *destination, int type, int error){
+    if(type==FILE_TYPE && error==0 && transfer->runStats.firstFileTime<0){
+        transfer->runStats.firstFileTime = getTime()-transfer->runStats.startTime;
+    }
+    if(transfer->completionCallback!=NULL){
+        transfer->completionCallback(transfer, source, destination, type, error, transfer->userData);
+    }
+}
+
+int initTransferLibrary(){
+    int err;
+#ifdef WIN32
+    // init windows socket (winsock DLL)
+    err = WSAStartup(MAKEWORD(2,0), &myWSAData);
+    if(err < 0) {
+        fprintf(stderr, "WSAStartup failed with error: %d\n", err);
+        return -1;
+    }
+#endif
+    // Init libssh2 functions
+    // flag = 0 because we don't have any flag to consider (like LIBSSH2_INIT_NO_CRYPTO) in the initialization.
+    // it's a global library initialization and it will init the crypto library (not thread safe, call it before starting the threads)
+    err = libssh2_init(0);
+    if(err < 0){
+        fprintf(stderr, "Can't init libssh2 functions! code error (%d).\n", err);
+        return -1;
+    }
+    return 0;
+}
+
+void exitTransferLibrary(){
+    // close Libssh2 functions we initialized using the libssh2_init function
+    libssh2_exit();
+#ifdef WIN32
+    WSACleanup();
+#endif
+}
+
+void initTransfer(sftpTransfer_t *transfer){
+    memset(transfer, 0, sizeof(sftpTransfer_t));
+    transfer->options = OPTION_UPLOAD; // upload (the authentication method is set per SSH remote device)
+    transfer->remoteSSH.port = 22;
+    transfer->remoteSSH.authMethod = OPTION_AUTH_PASSWORD;
+    transfer->relaySSH.port = 22;
+    transfer->relaySSH.authMethod = OPTION_AUTH_PASSWORD;
+    transfer->durabilityMode = DURABILITY_NONE;
+    transfer->dedupMode = DEDUP_NONE;
+    transfer->nbrRemoteListers = DEFAULT_REMOTE_LISTERS;
+    transfer->fanoutStallTimeout = DEFAULT_FANOUT_STALL_TIMEOUT;
+    transfer->fanoutLagTimeout = DEFAULT_FANOUT_LAG_TIMEOUT;
+    transfer->schedulePolicy = SCHEDULE_WALK;
+    transfer->scheduleWindow = DEFAULT_SCHEDULE_WINDOW;
+    transfer->filterMinSize = -1;
+    transfer->filterMaxSize = -1;
+    transfer->filterNewerThan = -1;
+    transfer->filterOlderThan = -1;
+    transfer->dataInput = stdin;
+    transfer->dataOutput = stdout;
+    transfer->remoteSyncSupported = 1;
+}
+
+static void freeListSourcePath(sftpTransfer_t *transfer){
+    while(transfer->listSourcePath!=NULL){
+        sourcePath_t *sourcePath = transfer->listSourcePath;
+        transfer->listSourcePath = sourcePath->nextSourcePath;
+        free(sourcePath->path);
+        free(sourcePath);
+    }
+}
+
+int isStandardStreamPath(char *path){
+    return path!=NULL && strcmp(path, STANDARD_STREAM_PATH)==0;
+}
+
+// add new source path to the list of source path
+void addPathToListSourcePath(sftpTransfer_t *transfer, char* sourcePath, int sourcePathType){
+    logTransfer(transfer, "add path %s with type %d\n", sourcePath, sourcePathType);
+    sourcePath_t *newPath = (sourcePath_t*)malloc(sizeof(sourcePath_t));
+    newPath->path = (char*)calloc(strlen(sourcePath)+1, sizeof(char));
+    strcpy(newPath->path, sourcePath);
+    // check if the end of path is '/' or '\' and delete it because we don't need it
+    if(strlen(newPath->path)>1 && (newPath->path[strlen(newPath->path)-1]=='/' || newPath->path[strlen(newPath->path)-1]=='\\')){
+        newPath->path[strlen(newPath->path)-1]='\0';
+    }
+    newPath->type = sourcePathType;
+    newPath->size = -1;
+    newPath->hashed = 0;
+    newPath->nextSourcePath=NULL;
+    if(transfer->listSourcePath == NULL){
+        transfer->listSourcePath = newPath;
+    }
+    else{
+        sourcePath_t *lastPath = transfer->listSourcePath;
+        while(lastPath->nextSourcePath != NULL){
+            lastPath = lastPath->nextSourcePath;
+        }
+        lastPath->nextSourcePath = newPath;
+    }
+}
+
+void setDestinationPath(sftpTransfer_t *transfer, char *path){
+    free(transfer->destinationPath);
+    transfer->destinationPath = (char*)calloc(strlen(path)+1, sizeof(char));
+    strcpy(transfer->destinationPath, path);
+    // check if the end of path is '/' or '\' and delete it because we don't need it
+    if(strlen(path)>1 && (path[strlen(path)-1]=='/' || path[strlen(path)-1]=='\\')){
+        transfer->destinationPath[strlen(path)-1]='\0';
+    }
+}
+
+void setTransferPaths(sftpTransfer_t *transfer, char *sourcePath, char *destinationPath){
+    freeListSourcePath(transfer);
+    addPathToListSourcePath(transfer, sourcePath, 0);
+    setDestinationPath(transfer, destinationPath);
+}
+
+// check if path is directory or file in the SSH remote device
+static int getRegisterTypeRemoteSSH(sftpTransfer_t *transfer, char *path){
+    int err;
+    LIBSSH2_SFTP_ATTRIBUTES registerStat;
+    err = libssh2_sftp_stat(transfer->sftp_session, path, &registerStat);
+    if(err<0){
+        logTransfer(transfer, "couldn't get the register stat from SSH remote device. error code: %d\n", err);
+        return -1;
+    }
+    if(LIBSSH2_SFTP_S_ISDIR(registerStat.permissions)){
+        return DIRECTORY_TYPE;
+    }
+    if(LIBSSH2_SFTP_S_ISREG(registerStat.permissions)){
+        return FILE_TYPE;
+    }
+    logTransfer(transfer, "unknown type but probably it's a file!\n");
+    return FILE_TYPE;
+}
+
+// check if path is directory or file in the SSH client device and get its size and last modification time (size and modificationTime could be NULL)
+static int getRegisterStatClientSSH(sftpTransfer_t *transfer, char *path, long long *size, long long *modificationTime){
+    struct stat registerStat;
+    if(stat(path, &registerStat)!=0){
+        logTransfer(transfer, "couldn't get the register stat from SSH client device.\n");
+        return -1;
+    }
+    if(size!=NULL){
+        *size = registerStat.st_size;
+    }
+    if(modificationTime!=NULL){
+        *modificationTime = registerStat.st_mtime;
+    }
+    if(S_ISDIR(registerStat.st_mode)){
+        return DIRECTORY_TYPE;
+    }
+    if(S_ISREG(registerStat.st_mode)){
+        return FILE_TYPE;
+    }
+    logTransfer(transfer, "unknown type but probably it's a file!\n");
+    return FILE_TYPE;
+}
+
+// check if path is directory or file in the SSH client device
+static int getRegisterTypeClientSSH(sftpTransfer_t *transfer, char *path){
+    return getRegisterStatClientSSH(transfer, path, NULL, NULL);
+}
+
+/*
+ * filter rules (-include/-exclude <glob>, -minsize/-maxsize <size>, -newer/-older <date>)
+ * rules are parsed once from the arguements and checked for every entry during the walk, before the entry is stored.
+ * an excluded directory is not stored and never opened, so its whole subtree is skipped.
+ *  + exclude rules apply to files and directories, and win over include rules
+ *  + include rules apply to files only: if there is at least one include rule, a file must match one of them
+ *  + size and modification time rules apply to files only
+ * glob: '*' any characters except separator, '**' any characters, '?' one character, '[abc]' '[a-z]' '[!abc]' one character of the set.
+ * a pattern with '/' is matched against the path relative to the source path, otherwise against the name only.
+ * a pattern ending with '/' matches directories only.
+ */
+
+static int isPathSeparator(char c){
+    return c=='/' || c=='\\';
+}
+
+// add new filter rule to the list of filter rules
+void addFilterRule(sftpTransfer_t *transfer, char *pattern, int filterType){
+    filterRule_t *newRule = (filterRule_t*)malloc(sizeof(filterRule_t));
+    // a leading separator only means "from the source path", the relative path doesn't start with it
+    while(isPathSeparator(pattern[0])){
+        pattern++;
+    }
+    newRule->pattern = (char*)calloc(strlen(pattern)+1, sizeof(char));
+    strcpy(newRule->pattern, pattern);
+    newRule->directoryOnly = 0;
+    while(strlen(newRule->pattern)>0 && isPathSeparator(newRule->pattern[strlen(newRule->pattern)-1])){
+        newRule->pattern[strlen(newRule->pattern)-1] = '\0';
+        newRule->directoryOnly = 1;
+    }
+    newRule->matchRelativePath = strchr(newRule->pattern, '/')!=NULL || strchr(newRule->pattern, '\\')!=NULL;
+    newRule->type = filterType;
+    newRule->nextFilterRule = NULL;
+    if(filterType==FILTER_INCLUDE){
+        transfer->nbrIncludeRules++;
+    }
+    if(transfer->listFilterRule==NULL){
+        transfer->listFilterRule = newRule;
+    }
+    else{
+        filterRule_t *lastRule = transfer->listFilterRule;
+        while(lastRule->nextFilterRule != NULL){
+            lastRule = lastRule->nextFilterRule;
+        }
+        lastRule->nextFilterRule = newRule;
+    }
+    logTransfer(transfer, "add %s filter rule %s\n", filterType==FILTER_INCLUDE ? "include" : "exclude", newRule->pattern);
+}
+
+// match the text against the glob pattern ('/' and '\\' are the same separator)
+static int matchGlob(char *pattern, char *text){
+    while(*pattern!='\0'){
+        if(pattern[0]=='*' && pattern[1]=='*'){
+            // '**' matches anything, separators included
+            while(*pattern=='*'){
+                pattern++;
+            }
+            do{
+                if(matchGlob(pattern, text)){
+                    return 1;
+                }
+            } while(*text++!='\0');
+            return 0;
+        }
+        if(*pattern=='*'){
+            pattern++;
+            do{
+                if(matchGlob(pattern, text)){
+                    return 1;
+                }
+            } while(*text!='\0' && !isPathSeparator(*text++));
+            return 0;
+        }
+        if(*text=='\0'){
+            return 0;
+        }
+        if(*pattern=='?'){
+            if(isPathSeparator(*text)){
+                return 0;
+            }
+        }
+        else if(*pattern=='['){
+            char *setEnd = strchr(pattern+1, ']');
+            if(setEnd==NULL){
+                // not a set, '[' is a normal character
+                if(*text!='['){
+                    return 0;
+                }
+            }
+            else{
+                char *setChar = pattern+1;
+                int negate = (*setChar=='!' || *setChar=='^');
+                int found = 0;
+                if(negate){
+                    setChar++;
+                }
+                for(; setChar<setEnd; setChar++){
+                    if(setChar[1]=='-' && setChar+2<setEnd){
+                        if(*text>=setChar[0] && *text<=setChar[2]){
+                            found = 1;
+                        }
+                        setChar += 2;
+                    }
+                    else if(*text==*setChar){
+                        found = 1;
+                    }
+                }
+                if(found==negate){
+                    return 0;
+                }
+                pattern = setEnd;
+            }
+        }
+        else if(isPathSeparator(*pattern)){
+            if(!isPathSeparator(*text)){
+                return 0;
+            }
+        }
+        else if(*pattern!=*text){
+            return 0;
+        }
+        pattern++;
+        text++;
+    }
+    return *text=='\0';
+}
+
+// check the filter rules. return 1 if the register must be skipped (size and modificationTime are -1 if unknown)
+static int isRegisterFiltered(sftpTransfer_t *transfer, char *relativePath, char *registerName, int registerType, long long size, long long modificationTime){
+    int included = (transfer->nbrIncludeRules==0 || registerType==DIRECTORY_TYPE);
+    filterRule_t *rule = transfer->listFilterRule;
+    while(rule!=NULL){
+        if(rule->directoryOnly==0 || registerType==DIRECTORY_TYPE){
+            if(matchGlob(rule->pattern, rule->matchRelativePath ? relativePath : registerName)){
+                if(rule->type==FILTER_EXCLUDE){
+                    logTransfer(transfer, "excluded by filter rule %s: %s\n", rule->pattern, relativePath);
+                    return 1;
+                }
+                if(registerType!=DIRECTORY_TYPE){
+                    included = 1;
+                }
+            }
+        }
+        rule = rule->nextFilterRule;
+    }
+    if(!included){
+        logTransfer(transfer, "not included by any filter rule: %s\n", relativePath);
+        return 1;
+    }
+    if(registerType==DIRECTORY_TYPE){
+        return 0;
+    }
+    if(size>=0 && ((transfer->filterMinSize>=0 && size<transfer->filterMinSize) || (transfer->filterMaxSize>=0 && size>transfer->filterMaxSize))){
+        logTransfer(transfer, "excluded by size filter (%lld bytes): %s\n", size, relativePath);
+        return 1;
+    }
+    if(modificationTime>=0 && ((transfer->filterNewerThan>=0 && modificationTime<transfer->filterNewerThan) || (transfer->filterOlderThan>=0 && modificationTime>=transfer->filterOlderThan))){
+        logTransfer(transfer, "excluded by modification time filter: %s\n", relativePath);
+        return 1;
+    }
+    return 0;
+}
+
+// parse size with an optional unit (K, M or G), return -1 if not valid
+long long parseFilterSize(char *sizeText){
+    char *unit = NULL;
+    long long size = strtoll(sizeText, &unit, 10);
+    if(unit==sizeText || size<0){
+        return -1;
+    }
+    switch(*unit){
+        case 'k': case 'K': size *= 1024LL; break;
+        case 'm': case 'M': size *= 1024LL*1024; break;
+        case 'g': case 'G': size *= 1024LL*1024*1024; break;
+        case '\0': break;
+        default: return -1;
+    }
+    return size;
+}
+
+// parse date (YYYY-MM-DD, local time) or seconds since epoch, return -1 if not valid
+long long parseFilterTime(char *timeText){
+    struct tm date;
+    memset(&date, 0, sizeof(struct tm));
+    if(sscanf(timeText, "%d-%d-%d", &date.tm_year, &date.tm_mon, &date.tm_mday)==3){
+        date.tm_year -= 1900;
+        date.tm_mon -= 1;
+        date.tm_isdst = -1;
+        return (long long)mktime(&date);
+    }
+    char *end = NULL;
+    long long seconds = strtoll(timeText, &end, 10);
+    if(end==timeText || *end!='\0'){
+        return -1;
+    }
+    return seconds;
+}
+
+// wait until the socket of one of the SSH remote devices is ready in the direction its session is blocked on (non-blocking mode)
+static int waitSocketRemoteSSH(sshRemote_t *remotes[], int nbrRemotes){
+    struct timeval timeout;
+    fd_set readSet;
+    fd_set writeSet;
+    int maxSocket = 0;
+    int remotePos;
+    timeout.tv_sec = 10;
+    timeout.tv_usec = 0;
+    FD_ZERO(&readSet);
+    FD_ZERO(&writeSet);
+    for(remotePos=0; remotePos<nbrRemotes; remotePos++){
+        int directions = libssh2_session_block_directions(remotes[remotePos]->session);
+        if(directions&LIBSSH2_SESSION_BLOCK_INBOUND){
+            FD_SET(remotes[remotePos]->socket, &readSet);
+        }
+        if(directions&LIBSSH2_SESSION_BLOCK_OUTBOUND){
+            FD_SET(remotes[remotePos]->socket, &writeSet);
+        }
+        if((int)remotes[remotePos]->socket > maxSocket){
+            maxSocket = (int)remotes[remotePos]->socket;
+        }
+    }
+    return select(maxSocket+1, &readSet, &writeSet, NULL, &timeout);
+}
+
+// hash the content of a file in the SSH client device (64 bits FNV-1a). return 0 on success
+static int hashFileClientSSH(sftpTransfer_t *transfer, char *path, unsigned long long *hash){
+    FILE *file_dp = fopen(path, "rb");
+    if(file_dp==NULL){
+        logTransfer(transfer, "couldn't open file %s to hash it!\n", path);
+        return -1;
+    }
+    unsigned char *hashBuffer = (unsigned char*)malloc(TRANSFER_CHUNK_SIZE*sizeof(unsigned char));
+    unsigned long long fileHash = 14695981039346656037ULL;
+    size_t nbrDataRead;
+    while((nbrDataRead = fread(hashBuffer, sizeof(unsigned char), TRANSFER_CHUNK_SIZE, file_dp))>0){
+        size_t dataPos;
+        for(dataPos=0; dataPos<nbrDataRead; dataPos++){
+            fileHash ^= hashBuffer[dataPos];
+            fileHash *= 1099511628211ULL;
+        }
+    }
+    int error = ferror(file_dp) ? -1 : 0;
+    free(hashBuffer);
+    fclose(file_dp);
+    *hash = fileHash;
+    return error;
+}
+
+/*
+ * walk of the source directory.
+ * the walk and the transfer loop are connected by a bounded queue of source paths (at most WALK_QUEUE_SIZE entries):
+ * when the transfer loop empties the queue, the walk continues from where it stopped until the queue is full again.
+ * a directory is always queued before its content (parents-first), and the first file is transferred as soon as it is found.
+ *  + SSH client device: depth first with a stack of open directories, the memory used depends on the queue size and the tree depth.
+ *  + SSH remote device: breadth first with a pool of listers. each lister has its own SFTP channel on the SSH session
+ *    (libssh2 allows one OPENDIR/READDIR request at a time per SFTP session), so up to nbrRemoteListers requests are in flight
+ *    at once and the round-trips overlap. the listers run in non-blocking mode and we wait on the socket only when none of them can progress.
+ *    the directories found wait for a free lister in a pending list of at most WALK_PENDING_SIZE directories. when it's full, a lister
+ *    goes depth first: it keeps the directory it's reading open and lists the sub directory first, so the memory used depends on
+ *    the queue size, the pending list size, the tree depth and the number of listers, not on the width of the tree.
+ *
+ * schedule policies: with the walk policy the files are transferred in the walk order. the other policies read the walk ahead
+ * (up to scheduleWindow entries, the sizes come from the stat/readdir attributes of the walk) and choose the next file in the queue:
+ *  + largest: the largest file first, the long transfers don't end up alone at the tail of the run.
+ *  + smallest: the smallest file first, the most files are done early.
+ *  + mixed: alternate the largest and the smallest file. the files share one SFTP session and are transferred one after the other,
+ *    so the big files start early and the small files keep completing between them.
+ * the directories are always chosen first, in the walk order, so a parent directory is still created before its content.
+ * the reordering only happens inside the window (at most MAX_SCHEDULE_WINDOW entries), a big file listed after it is still transferred late.
+ * the time of each entry is measured to fit a cost model (time = file latency + size / throughput). after SCHEDULE_PREDICTION_SAMPLES files
+ * the entries listed so far are predicted once with the model, and the run stats print the predicted completion time against the actual one.
+ */
+#define WALK_QUEUE_SIZE 256
+#define SCHEDULE_PREDICTION_SAMPLES 16
+#define WALK_PENDING_SIZE 1024
+// one open directory of the walk in the SSH client device
+typedef struct walkDirectory_struct
+{
+    char *path;
+    DIR *dir_handle;
+    struct walkDirectory_struct *parentDirectory;
+}walkDirectory_t;
+// state of a lister of the SSH remote device
+enum{
+    LISTER_IDLE=0,
+    LISTER_OPENING,
+    LISTER_READING,
+    LISTER_CLOSING
+};
+// directory of a lister left open while it lists a sub directory (depth first when the pending list is full)
+typedef struct listerDirectory_struct
+{
+    char *path;
+    LIBSSH2_SFTP_HANDLE *sftp_dirHandle;
+    struct listerDirectory_struct *parentDirectory;
+}listerDirectory_t;
+typedef struct remoteLister_struct
+{
+    LIBSSH2_SFTP *sftp_session; // own SFTP channel, so the lister requests don't wait for the other listers
+    LIBSSH2_SFTP_HANDLE *sftp_dirHandle;
+    char *path; // directory being listed
+    int state;
+    listerDirectory_t *parentDirectory; // stack of the directories left open by the depth first listing
+}remoteLister_t;
+typedef struct walker_struct
+{
+    int remote; // 1 to walk the SSH remote device, 0 to walk the SSH client device
+    int recursivity;
+    walkDirectory_t *currentDirectory; // SSH client device: top of the stack of open directories
+    remoteLister_t *listers; // SSH remote device: pool of listers
+    int nbrListers;
+    sourcePath_t *pendingHead; // SSH remote device: directories waiting for a lister
+    sourcePath_t *pendingTail;
+    int nbrPendingDirectories;
+    sourcePath_t *queueHead; // next source path to transfer
+    sourcePath_t *queueTail;
+    int queueLength;
+    int queueLimit; // WALK_QUEUE_SIZE, or the schedule window with a size policy
+    int walkDone; // no more entry to queue
+    int pickLargest; // mixed policy: the next file is the largest of the queue
+    // entry returned by the last nextWalkSourcePath, measured at the next call
+    int currentType;
+    long long currentSize;
+    double currentStartTime;
+    // sums of the measured entries for the cost model
+    long long nbrFileSamples;
+    double sumSize;
+    double sumTime;
+    double sumSizeSize;
+    double sumSizeTime;
+    long long nbrDirectorySamples;
+    double sumDirectoryTime;
+    // entries listed by the walk so far
+    long long nbrListedFiles;
+    long long nbrListedDirectories;
+    double listedBytes;
+}walker_t;
+
+// open a directory in the SSH client device and put it on the top of the stack of open directories
+static int pushWalkDirectory(sftpTransfer_t *transfer, walker_t *walker, char *path){
+    walkDirectory_t *directory = (walkDirectory_t*)calloc(1, sizeof(walkDirectory_t));
+    directory->dir_handle = opendir(path);
+    if(directory->dir_handle==NULL){
+        logTransfer(transfer, "couldn't open directory '%s' from SSH client device.\n", path);
+        free(directory);
+        return -1;
+    }
+    directory->path = (char*)calloc(strlen(path)+1, sizeof(char));
+    strcpy(directory->path, path);
+    directory->parentDirectory = walker->currentDirectory;
+    walker->currentDirectory = directory;
+    return 0;
+}
+
+// close the directory on the top of the stack of open directories and get back to its parent
+static void popWalkDirectory(walker_t *walker){
+    walkDirectory_t *directory = walker->currentDirectory;
+    if(directory==NULL){
+        return;
+    }
+    closedir(directory->dir_handle);
+    walker->currentDirectory = directory->parentDirectory;
+    free(directory->path);
+    free(directory);
+}
+
+// read the next register of a directory in the SSH client device. return its full path (to free) or NULL at the end of the directory
+static char *readWalkDirectoryClientSSH(sftpTransfer_t *transfer, walkDirectory_t *directory, int *registerType, long long *size, long long *modificationTime){
+    struct dirent *dir_attrs;
+    while((dir_attrs=readdir(directory->dir_handle))!=NULL){
+        if(strcmp(dir_attrs->d_name, ".")==0 || strcmp(dir_attrs->d_name, "..")==0){
+            continue;
+        }
+        logTransfer(transfer, "found file/directory %s\n",dir_attrs->d_name);
+        char *registerPath = (char*)calloc(strlen(directory->path)+2+strlen(dir_attrs->d_name), sizeof(char));
+        sprintf(registerPath, "%s\\%s", directory->path, dir_attrs->d_name);
+        *registerType = getRegisterStatClientSSH(transfer, registerPath, size, modificationTime);
+        return registerPath;
+    }
+    return NULL;
+}
+
+// add a source path at the end of a list (walk queue or pending directories)
+static void appendSourcePath(sourcePath_t **head, sourcePath_t **tail, char *path, int type){
+    sourcePath_t *sourcePath = (sourcePath_t*)malloc(sizeof(sourcePath_t));
+    sourcePath->path = (char*)calloc(strlen(path)+1, sizeof(char));
+    strcpy(sourcePath->path, path);
+    sourcePath->type = type;
+    sourcePath->size = -1;
+    sourcePath->hashed = 0;
+    sourcePath->nextSourcePath = NULL;
+    if(*tail==NULL){
+        *head = sourcePath;
+    }
+    else{
+        (*tail)->nextSourcePath = sourcePath;
+    }
+    *tail = sourcePath;
+}
+
+// remove the first source path of a list (walk queue or pending directories), NULL if the list is empty
+static sourcePath_t *removeFirstSourcePath(sourcePath_t **head, sourcePath_t **tail){
+    sourcePath_t *sourcePath = *head;
+    if(sourcePath==NULL){
+        return NULL;
+    }
+    *head = sourcePath->nextSourcePath;
+    if(*head==NULL){
+        *tail = NULL;
+    }
+    sourcePath->nextSourcePath = NULL;
+    return sourcePath;
+}
+
+static void freeSourcePath(sourcePath_t *sourcePath){
+    free(sourcePath->path);
+    free(sourcePath);
+}
+
+// check the filter rules and queue the register found by the walk. return 1 if it was queued
+static int queueWalkRegister(sftpTransfer_t *transfer, walker_t *walker, char *registerPath, char *registerName, int registerType, long long size, long long modificationTime){
+    // skip filtered registers, a filtered directory is never opened
+    if(isRegisterFiltered(transfer, registerPath+strlen(transfer->listSourcePath->path)+1, registerName, registerType, size, modificationTime)){
+        return 0;
+    }
+    appendSourcePath(&walker->queueHead, &walker->queueTail, registerPath, registerType);
+    walker->queueLength++;
+    walker->queueTail->size = size;
+    // entries listed so far, for the prediction of the completion time
+    if(registerType==DIRECTORY_TYPE){
+        walker->nbrListedDirectories++;
+    }
+    else{
+        walker->nbrListedFiles++;
+        walker->listedBytes += (size>0) ? size : 0;
+    }
+    // in dedup mode the local files are hashed during the walk
+    if(transfer->dedupMode!=DEDUP_NONE && !walker->remote && registerType==FILE_TYPE && size>=DEDUP_MIN_SIZE){
+        walker->queueTail->hashed = (hashFileClientSSH(transfer, registerPath, &walker->queueTail->hash)==0);
+    }
+    return 1;
+}
+
+// continue the depth first walk of the SSH client device until the queue is full or the walk is done
+static void fillWalkQueueClientSSH(sftpTransfer_t *transfer, walker_t *walker){
+    while(walker->queueLength<walker->queueLimit && walker->currentDirectory!=NULL){
+        walkDirectory_t *directory = walker->currentDirectory;
+        int registerType = 0;
+        long long registerSize = -1;
+        long long registerTime = -1;
+        char *registerPath = readWalkDirectoryClientSSH(transfer, directory, &registerType, &registerSize, &registerTime);
+        // end of the directory, back to the parent directory
+        if(registerPath==NULL){
+            popWalkDirectory(walker);
+            continue;
+        }
+        // queue the current path before walking through the directory
+        if(queueWalkRegister(transfer, walker, registerPath, registerPath+strlen(directory->path)+1, registerType, registerSize, registerTime)){
+            // walk through the sub directory if recursivity option is enabled
+            if(registerType == DIRECTORY_TYPE && walker->recursivity){
+                pushWalkDirectory(transfer, walker, registerPath);
+            }
+        }
+        free(registerPath);
+    }
+    if(walker->currentDirectory==NULL){
+        walker->walkDone = 1;
+    }
+}
+
+// keep the directory the lister is reading open and start to list the sub directory
+static void pushListerDirectory(remoteLister_t *lister, char *path){
+    listerDirectory_t *directory = (listerDirectory_t*)malloc(sizeof(listerDirectory_t));
+    directory->path = lister->path;
+    directory->sftp_dirHandle = lister->sftp_dirHandle;
+    directory->parentDirectory = lister->parentDirectory;
+    lister->parentDirectory = directory;
+    lister->path = (char*)calloc(strlen(path)+1, sizeof(char));
+    strcpy(lister->path, path);
+    lister->sftp_dirHandle = NULL;
+    lister->state = LISTER_OPENING;
+}
+
+// the lister is done with its directory: continue the parent directory left open, or wait for a pending directory
+static void popListerDirectory(remoteLister_t *lister){
+    free(lister->path);
+    lister->path = NULL;
+    lister->state = LISTER_IDLE;
+    listerDirectory_t *directory = lister->parentDirectory;
+    if(directory!=NULL){
+        lister->path = directory->path;
+        lister->sftp_dirHandle = directory->sftp_dirHandle;
+        lister->parentDirectory = directory->parentDirectory;
+        lister->state = LISTER_READING;
+        free(directory);
+    }
+}
+
+// move a lister one step forward (non-blocking). return 1 if it progressed, 0 if it's waiting for the SSH remote device or has nothing to do
+static int stepRemoteLister(sftpTransfer_t *transfer, walker_t *walker, remoteLister_t *lister){
+    if(lister->state==LISTER_IDLE){
+        sourcePath_t *pendingDirectory = removeFirstSourcePath(&walker->pendingHead, &walker->pendingTail);
+        if(pendingDirectory==NULL){
+            return 0;
+        }
+        walker->nbrPendingDirectories--;
+        lister->path = pendingDirectory->path;
+        free(pendingDirectory);
+        lister->state = LISTER_OPENING;
+    }
+    if(lister->state==LISTER_OPENING){
+        lister->sftp_dirHandle = libssh2_sftp_opendir(lister->sftp_session, lister->path);
+        if(lister->sftp_dirHandle==NULL){
+            if(libssh2_session_last_errno(transfer->remoteSSH.session)==LIBSSH2_ERROR_EAGAIN){
+                return 0;
+            }
+            logTransfer(transfer, "couldn't open directory '%s' from SSH remote device. error code: %I32u.\n", lister->path, libssh2_sftp_last_error(lister->sftp_session));
+            popListerDirectory(lister);
+            return 1;
+        }
+        lister->state = LISTER_READING;
+    }
+    if(lister->state==LISTER_READING){
+        char registerName[1024*4];
+        LIBSSH2_SFTP_ATTRIBUTES attrs;
+        int readBuffer = libssh2_sftp_readdir(lister->sftp_dirHandle, registerName, sizeof(registerName), &attrs);
+        if(readBuffer==LIBSSH2_ERROR_EAGAIN){
+            return 0;
+        }
+        if(readBuffer<=0){
+            // end of the directory (or error), close it
+            lister->state = LISTER_CLOSING;
+        }
+        else if(strcmp(registerName, ".")==0 || strcmp(registerName, "..")==0){
+            return 1;
+        }
+        else if(!(attrs.flags & LIBSSH2_SFTP_ATTR_PERMISSIONS)){
+            logTransfer(transfer, "couldn't get the register type.\n");
+            return 1;
+        }
+        else{
+            logTransfer(transfer, "%s", registerName);
+            int registerType;
+            if(LIBSSH2_SFTP_S_ISDIR(attrs.permissions)){
+                logTransfer(transfer, " --dir-- \n");
+                registerType = DIRECTORY_TYPE;
+            }
+            else if(LIBSSH2_SFTP_S_ISREG(attrs.permissions)){
+                logTransfer(transfer, " --file-- \n");
+                registerType = FILE_TYPE;
+            }
+            else{
+                logTransfer(transfer, "unknown register type is still a file type.\n");
+                registerType = FILE_TYPE;
+            }
+            // set the new path (sub directory path)
+            char *registerPath = (char*)calloc(strlen(lister->path)+2+readBuffer, sizeof(char));
+            sprintf(registerPath, "%s/%s", lister->path, registerName);
+            long long registerSize = (attrs.flags & LIBSSH2_SFTP_ATTR_SIZE) ? (long long)attrs.filesize : -1;
+            long long registerTime = (attrs.flags & LIBSSH2_SFTP_ATTR_ACMODTIME) ? (long long)attrs.mtime : -1;
+            // queue the current path, its content will be listed later by the first free lister
+            if(queueWalkRegister(transfer, walker, registerPath, registerName, registerType, registerSize, registerTime)){
+                if(registerType == DIRECTORY_TYPE && walker->recursivity){
+                    if(walker->nbrPendingDirectories<WALK_PENDING_SIZE){
+                        appendSourcePath(&walker->pendingHead, &walker->pendingTail, registerPath, DIRECTORY_TYPE);
+                        walker->nbrPendingDirectories++;
+                    }
+                    else{
+                        // the pending list is full, list the sub directory now and come back to this one after
+                        pushListerDirectory(lister, registerPath);
+                    }
+                }
+            }
+            free(registerPath);
+            return 1;
+        }
+    }
+    if(lister->state==LISTER_CLOSING){
+        if(libssh2_sftp_closedir(lister->sftp_dirHandle)==LIBSSH2_ERROR_EAGAIN){
+            return 0;
+        }
+        lister->sftp_dirHandle = NULL;
+        popListerDirectory(lister);
+    }
+    return 1;
+}
+
+// continue the breadth first walk of the SSH remote device until the queue is full or the walk is done
+static void fillWalkQueueRemoteSSH(sftpTransfer_t *transfer, walker_t *walker){
+    sshRemote_t *remotes[1] = {&transfer->remoteSSH};
+    libssh2_session_set_blocking(transfer->remoteSSH.session, 0);
+    while(walker->queueLength<walker->queueLimit){
+        int progress = 0;
+        int busy = (walker->pendingHead!=NULL);
+        int listerPos;
+        for(listerPos=0; listerPos<walker->nbrListers && walker->queueLength<walker->queueLimit; listerPos++){
+            progress |= stepRemoteLister(transfer, walker, &walker->listers[listerPos]);
+            if(walker->listers[listerPos].state!=LISTER_IDLE){
+                busy = 1;
+            }
+        }
+        // all listers are idle and no more directory to list, the walk is done
+        if(!busy && walker->pendingHead==NULL){
+            walker->walkDone = 1;
+            break;
+        }
+        // all the busy listers are waiting for the SSH remote device
+        if(!progress){
+            waitSocketRemoteSSH(remotes, 1);
+        }
+    }
+    // back to blocking mode for the transfer
+    libssh2_session_set_blocking(transfer->remoteSSH.session, 1);
+}
+
+// start the walk of the source directory (remote: 1 for the SSH remote device, 0 for the SSH client device)
+static void startWalk(sftpTransfer_t *transfer, walker_t *walker, char *sourcePath, int remote, int recursivity){
+    memset(walker, 0, sizeof(walker_t));
+    walker->remote = remote;
+    walker->recursivity = recursivity;
+    walker->queueLimit = (transfer->schedulePolicy==SCHEDULE_WALK) ? WALK_QUEUE_SIZE : transfer->scheduleWindow;
+    walker->pickLargest = 1;
+    if(!remote){
+        pushWalkDirectory(transfer, walker, sourcePath);
+        return;
+    }
+    // open one SFTP channel per lister
+    walker->listers = (remoteLister_t*)calloc(transfer->nbrRemoteListers, sizeof(remoteLister_t));
+    for(walker->nbrListers=0; walker->nbrListers<transfer->nbrRemoteListers; walker->nbrListers++){
+        walker->listers[walker->nbrListers].sftp_session = libssh2_sftp_init(transfer->remoteSSH.session);
+        if(walker->listers[walker->nbrListers].sftp_session==NULL){
+            logTransfer(transfer, "couldn't init SFTP session for lister %d, continue with %d listers.\n", walker->nbrListers, walker->nbrListers);
+            break;
+        }
+    }
+    // at least one lister is needed, use the main SFTP session
+    if(walker->nbrListers==0){
+        walker->listers[0].sftp_session = transfer->sftp_session;
+        walker->nbrListers = 1;
+    }
+    logTransfer(transfer, "list SSH remote device with %d listers\n", walker->nbrListers);
+    appendSourcePath(&walker->pendingHead, &walker->pendingTail, sourcePath, DIRECTORY_TYPE);
+    walker->nbrPendingDirectories = 1;
+}
+
+// add the time of the entry returned by the last nextWalkSourcePath to the cost model
+static void addScheduleSample(walker_t *walker){
+    if(walker->currentStartTime<=0){
+        return;
+    }
+    double time = getTime()-walker->currentStartTime;
+    if(walker->currentType==DIRECTORY_TYPE){
+        walker->nbrDirectorySamples++;
+        walker->sumDirectoryTime += time;
+    }
+    else{
+        double size = (walker->currentSize>0) ? walker->currentSize : 0;
+        walker->nbrFileSamples++;
+        walker->sumSize += size;
+        walker->sumTime += time;
+        walker->sumSizeSize += size*size;
+        walker->sumSizeTime += size*time;
+    }
+    walker->currentStartTime = 0;
+}
+
+// cost model fitted on the transferred files: time = file latency + size * time per byte (least squares), at least one file sample is needed
+static void getScheduleModel(walker_t *walker, double *fileLatency, double *timePerByte){
+    double nbrSamples = walker->nbrFileSamples;
+    double denominator = nbrSamples*walker->sumSizeSize - walker->sumSize*walker->sumSize;
+    if(nbrSamples>=2 && denominator>0){
+        *timePerByte = (nbrSamples*walker->sumSizeTime - walker->sumSize*walker->sumTime)/denominator;
+        *fileLatency = (walker->sumTime - *timePerByte*walker->sumSize)/nbrSamples;
+        if(*timePerByte>0 && *fileLatency>=0){
+            return;
+        }
+    }
+    // not enough different sizes to fit the file latency, only the average throughput
+    if(walker->sumSize>0){
+        *fileLatency = 0;
+        *timePerByte = walker->sumTime/walker->sumSize;
+        return;
+    }
+    *fileLatency = walker->sumTime/nbrSamples;
+    *timePerByte = 0;
+}
+
+// predict the completion time of the run once, after SCHEDULE_PREDICTION_SAMPLES files (or when the walk is done if it's sooner):
+// elapsed time plus the model time of the entries listed and not transferred yet. if the walk isn't done, the entries listed later are not in it
+static void predictCompletion(sftpTransfer_t *transfer, walker_t *walker){
+    if(walker->nbrFileSamples==0 || transfer->runStats.predictedTime>=0){
+        return;
+    }
+    if(walker->nbrFileSamples<SCHEDULE_PREDICTION_SAMPLES && !walker->walkDone){
+        return;
+    }
+    double fileLatency, timePerByte;
+    getScheduleModel(walker, &fileLatency, &timePerByte);
+    double remainingTime = (walker->nbrListedFiles-walker->nbrFileSamples)*fileLatency + (walker->listedBytes-walker->sumSize)*timePerByte;
+    if(walker->nbrDirectorySamples>0){
+        remainingTime += (walker->nbrListedDirectories-walker->nbrDirectorySamples)*walker->sumDirectoryTime/walker->nbrDirectorySamples;
+    }
+    transfer->runStats.predictionTime = getTime()-transfer->runStats.startTime;
+    transfer->runStats.predictedTime = transfer->runStats.predictionTime + remainingTime;
+    transfer->runStats.predictionListedFiles = walker->nbrListedFiles;
+    transfer->runStats.predictionWalkDone = walker->walkDone;
+}
+
+// remove from the queue the next source path of the schedule policy: the first directory, else the largest or the smallest file
+static sourcePath_t *removeScheduledSourcePath(sftpTransfer_t *transfer, walker_t *walker){
+    int pickLargest = (transfer->schedulePolicy==SCHEDULE_LARGEST) || (transfer->schedulePolicy==SCHEDULE_MIXED && walker->pickLargest);
+    sourcePath_t *previousSourcePath = NULL;
+    sourcePath_t *chosenSourcePath = NULL;
+    sourcePath_t *chosenPreviousSourcePath = NULL;
+    sourcePath_t *sourcePath;
+    for(sourcePath=walker->queueHead; sourcePath!=NULL; previousSourcePath=sourcePath, sourcePath=sourcePath->nextSourcePath){
+        if(sourcePath->type==DIRECTORY_TYPE){
+            chosenSourcePath = sourcePath;
+            chosenPreviousSourcePath = previousSourcePath;
+            break;
+        }
+        // on equal sizes the walk order is kept (unknown size is -1, the smallest)
+        if(chosenSourcePath==NULL || (pickLargest ? sourcePath->size>chosenSourcePath->size : sourcePath->size<chosenSourcePath->size)){
+            chosenSourcePath = sourcePath;
+            chosenPreviousSourcePath = previousSourcePath;
+        }
+    }
+    if(chosenSourcePath==NULL){
+        return NULL;
+    }
+    if(chosenPreviousSourcePath==NULL){
+        walker->queueHead = chosenSourcePath->nextSourcePath;
+    }
+    else{
+        chosenPreviousSourcePath->nextSourcePath = chosenSourcePath->nextSourcePath;
+    }
+    if(walker->queueTail==chosenSourcePath){
+        walker->queueTail = chosenPreviousSourcePath;
+    }
+    chosenSourcePath->nextSourcePath = NULL;
+    if(chosenSourcePath->type==FILE_TYPE){
+        walker->pickLargest = !walker->pickLargest;
+    }
+    return chosenSourcePath;
+}
+
+// get the next source path to transfer (to free with freeSourcePath), NULL when the walk is done
+static sourcePath_t *nextWalkSourcePath(sftpTransfer_t *transfer, walker_t *walker){
+    addScheduleSample(walker);
+    // the walk policy waits for an empty queue, the size policies keep the window full to choose from
+    if(walker->queueHead==NULL || (transfer->schedulePolicy!=SCHEDULE_WALK && !walker->walkDone && walker->queueLength<walker->queueLimit)){
+        if(walker->remote){
+            fillWalkQueueRemoteSSH(transfer, walker);
+        }
+        else{
+            fillWalkQueueClientSSH(transfer, walker);
+        }
+    }
+    predictCompletion(transfer, walker);
+    sourcePath_t *sourcePath;
+    if(transfer->schedulePolicy==SCHEDULE_WALK){
+        sourcePath = removeFirstSourcePath(&walker->queueHead, &walker->queueTail);
+    }
+    else{
+        sourcePath = removeScheduledSourcePath(transfer, walker);
+    }
+    if(sourcePath!=NULL){
+        walker->queueLength--;
+        walker->currentType = sourcePath->type;
+        walker->currentSize = sourcePath->size;
+        walker->currentStartTime = getTime();
+    }
+    return sourcePath;
+}
+
+// stop the walk: close the open directories, the listers and free the queue
+static void stopWalk(sftpTransfer_t *transfer, walker_t *walker){
+    while(walker->currentDirectory!=NULL){
+        popWalkDirectory(walker);
+    }
+    int listerPos;
+    for(listerPos=0; listerPos<walker->nbrListers; listerPos++){
+        remoteLister_t *lister = &walker->listers[listerPos];
+        while(lister->path!=NULL){
+            if(lister->sftp_dirHandle!=NULL){
+                libssh2_sftp_closedir(lister->sftp_dirHandle);
+                lister->sftp_dirHandle = NULL;
+            }
+            popListerDirectory(lister);
+        }
+        if(lister->sftp_session!=transfer->sftp_session){
+            libssh2_sftp_shutdown(lister->sftp_session);
+        }
+    }
+    free(walker->listers);
+    walker->listers = NULL;
+    walker->nbrListers = 0;
+    sourcePath_t *sourcePath;
+    while((sourcePath=removeFirstSourcePath(&walker->pendingHead, &walker->pendingTail))!=NULL){
+        freeSourcePath(sourcePath);
+    }
+    walker->nbrPendingDirectories = 0;
+    while((sourcePath=removeFirstSourcePath(&walker->queueHead, &walker->queueTail))!=NULL){
+        freeSourcePath(sourcePath);
+    }
+    walker->queueLength = 0;
+}
+
+// verify the login options of one SSH remote device
+static int verifyRemoteSSHOptions(sftpTransfer_t *transfer, sshRemote_t *remote){
+    int error = 0;
+    logTransfer(transfer, "ip %s, ", remote->ip);
+    if(remote->ip==NULL || strcmp(remote->ip, "")==0){
+        logTransfer(transfer, "ssh remote ip not valid!");
+        error = -1;
+    }
+    logTransfer(transfer, "port %d, ", remote->port);
+    if(remote->port<0 || remote->port>65535){
+        logTransfer(transfer, "ssh remote port not valid!");
+        error = -1;
+    }
+    logTransfer(transfer, "userName %s, ", remote->userName);
+    if(remote->userName==NULL || strcmp(remote->userName, "")==0){
+        logTransfer(transfer, "userName not valid!");
+        error = -1;
+    }
+    // never log the password itself, the log goes to the application embedding the library
+    logTransfer(transfer, "password %s, ", (remote->password==NULL) ? "missing" : "set");
+    if(remote->password==NULL){
+        logTransfer(transfer, "password not valid!");
+        error = -1;
+    }
+    if(remote->authMethod==OPTION_AUTH_PUBKEY){
+        if(remote->publicKeyPath==NULL || strcmp(remote->publicKeyPath,"")==0){
+            logTransfer(transfer, "public key path is missing for public/private key authentication methid\n");
+            error = -1;
+        }
+        if(remote->privateKeyPath==NULL || strcmp(remote->privateKeyPath,"")==0){
+            logTransfer(transfer, "private key path is missing for public/private key authentication methid\n");
+            error = -1;
+        }
+    }
+    return error;
+}
+
+static int verifyLogingOptions(sftpTransfer_t *transfer){
+    // verify options (source path must be existe(exit if not found), destination path must be existe (exit if not found), recursivity should be used only on directory (worning if not the case))
+    logTransfer(transfer, "verify options\n");
+    int error = verifyRemoteSSHOptions(transfer, &transfer->remoteSSH);
+    if((transfer->options&OPTION_RELAY_MASK)==OPTION_RELAY){
+        logTransfer(transfer, "relay ");
+        if(verifyRemoteSSHOptions(transfer, &transfer->relaySSH)!=0){
+            error = -1;
+        }
+    }
+    logTransfer(transfer, "verif login options done\n");
+    return error;
+}
+
+static int verifyTransferOptions(sftpTransfer_t *transfer){
+    int error = 0;
+    logTransfer(transfer, "options %02X, ", transfer->options);
+    // get and save the source path type (diretory or file)
+    // if it's a download action, source path is in the SSH remote device
+    // if it's an upload action, source path is in the SSH client device
+    // if it's a relay action, source path is in the SSH remote device too
+    if((transfer->options&OPTION_RELAY_MASK)==OPTION_RELAY){
+        logTransfer(transfer, "Relay, ");
+        if(isStandardStreamPath(transfer->listSourcePath->path) || isStandardStreamPath(transfer->destinationPath)){
+            logTransfer(transfer, "standard input/output can't be used in relay mode!");
+            error = -1;
+        }
+        if(transfer->dedupMode!=DEDUP_NONE){
+            logTransfer(transfer, "dedup is only for upload, ignored! ");
+            transfer->dedupMode = DEDUP_NONE;
+        }
+        transfer->listSourcePath->type = getRegisterTypeRemoteSSH(transfer, transfer->listSourcePath->path);
+    }
+    else if((transfer->options&OPTION_ACTION_MASK)==OPTION_DOWNLOAD){
+        logTransfer(transfer, "Download, ");
+        // the dedup works on the content we upload, nothing to do in download
+        if(transfer->dedupMode!=DEDUP_NONE){
+            logTransfer(transfer, "dedup is only for upload, ignored! ");
+            transfer->dedupMode = DEDUP_NONE;
+        }
+        transfer->listSourcePath->type = getRegisterTypeRemoteSSH(transfer, transfer->listSourcePath->path);
+        // only one file can be written to the standard output
+        if(isStandardStreamPath(transfer->destinationPath) && transfer->listSourcePath->type!=FILE_TYPE){
+            logTransfer(transfer, "only a file can be downloaded to the standard output!");
+            error = -1;
+        }
+    }
+    else if((transfer->options&OPTION_ACTION_MASK)==OPTION_UPLOAD){
+        logTransfer(transfer, "Upload, ");
+        logTransfer(transfer, "%s", transfer->listSourcePath->path);
+        // the standard input is a stream of data, we can't get its stat but it's like a file
+        if(isStandardStreamPath(transfer->listSourcePath->path)){
+            transfer->listSourcePath->type = FILE_TYPE;
+        }
+        else{
+            transfer->listSourcePath->type = getRegisterTypeClientSSH(transfer, transfer->listSourcePath->path);
+        }
+    }
+    else{
+        logTransfer(transfer, "unknown option, Download or Upload?, ");
+        error = -1;
+    }
+    logTransfer(transfer, "source path %s type %d, ", transfer->listSourcePath->path, transfer->listSourcePath->type);
+    if(transfer->listSourcePath->path==NULL || strcmp(transfer->listSourcePath->path, "")==0){
+        logTransfer(transfer, "source path not valid!");
+        error = -1;
+    }
+    logTransfer(transfer, "recursivity %d, ", transfer->options&OPTION_REC_MASK);
+    if(transfer->listSourcePath->type!=DIRECTORY_TYPE && (transfer->options&OPTION_REC_MASK)==OPTION_REC){
+        logTransfer(transfer, "worning, no need to use recursivity for non directory source path!");
+    }
+    logTransfer(transfer, "destination %s\n", transfer->destinationPath);
+    if(transfer->destinationPath==NULL || strcmp(transfer->destinationPath, "")==0){
+        logTransfer(transfer, "destination path not valid!");
+        error = -1;
+    }
+    if(transfer->schedulePolicy!=SCHEDULE_WALK && (transfer->scheduleWindow<1 || transfer->scheduleWindow>MAX_SCHEDULE_WINDOW)){
+        logTransfer(transfer, "schedule window %d not valid, use %d!\n", transfer->scheduleWindow, DEFAULT_SCHEDULE_WINDOW);
+        transfer->scheduleWindow = DEFAULT_SCHEDULE_WINDOW;
+    }
+    logTransfer(transfer, "verif transfer options done\n");
+    return error;
+}
+
+// create dir in SSH remote device using the given SFTP session.(this function will create the parent dir if not exist)
+static int createDirInRemoteSSH(sftpTransfer_t *transfer, LIBSSH2_SFTP *sftp, char *dir){
+    int err;
+    startCreateDirectoryAgain:
+    err = libssh2_sftp_mkdir(sftp, dir, LIBSSH2_SFTP_S_IRWXG|LIBSSH2_SFTP_S_IRWXU|LIBSSH2_SFTP_S_IROTH);
+    logTransfer(transfer, "create directory => %s\n", dir);
+    if(err<0){
+        // SFTP protocol error handler
+        if(err==LIBSSH2_ERROR_EAGAIN){
+            logTransfer(transfer, "LIBSSH2_ERROR_EAGAIN\n");
+            // set this later.
+            return -1; // for now it's an error
+        }
+        else if(err==LIBSSH2_ERROR_SFTP_PROTOCOL){
+            logTransfer(transfer, "problem in creating directory: looking for a solution...\n");
+            if(libssh2_sftp_last_error(sftp)==LIBSSH2_FX_FAILURE){
+                logTransfer(transfer, "directory already existe.\n");
+            }
+            else if(libssh2_sftp_last_error(sftp)==LIBSSH2_FX_NO_SUCH_FILE){
+                logTransfer(transfer, "maybe parent doesn't existe. try create parent.\n");
+                // remote path could be separated with '/' or '\\' (destination path from the arguements)
+                char *lastSeparator = strrchr(dir,'/');
+                if(lastSeparator==NULL || (strrchr(dir,'\\')!=NULL && strrchr(dir,'\\')>lastSeparator)){
+                    lastSeparator = strrchr(dir,'\\');
+                }
+                if(lastSeparator==NULL || lastSeparator==dir){
+                    logTransfer(transfer, "couldn't find parent directory of %s!\n", dir);
+                    return -1;
+                }
+                int parentDirLen = lastSeparator-dir;
+                char *parentDir = (char*)calloc(parentDirLen+1, sizeof(char));
+                strncpy(parentDir, dir, parentDirLen);
+                int parentErr = createDirInRemoteSSH(transfer, sftp, parentDir);
+                free(parentDir);
+                if(parentErr==0){
+                    goto startCreateDirectoryAgain;
+                }
+                else{
+                    logTransfer(transfer, "couldn't create parent directory!\n");
+                    return -1;
+                }
+            }
+            else{
+                logTransfer(transfer, "couldn't create directory %s! error code: %d - %I32u\n",dir, err, libssh2_sftp_last_error(sftp));
+                return -1;
+            }
+        }
+        else{
+            logTransfer(transfer, "couldn't create directory %s! error code: %d.\n",dir, err);
+            return -1;
+        }
+    }
+    else{
+        logTransfer(transfer, "directory created => %s\n", dir);
+    }
+    return 0;
+}
+
+// create dir in SSH local device
+static int createDirInClientSSH(sftpTransfer_t *transfer, char *dir){
+#ifndef WIN32
+    int err;
+#endif
+    startCreateDirectoryAgain:
+#ifdef WIN32
+    if(!CreateDirectory(dir, NULL)){
+        if(GetLastError()!=ERROR_ALREADY_EXISTS){
+#elif UNIX || LINUX
+    err = mkdir(dir, 0774);
+    if (err != 0) {
+        if (err != EEXIST) {
+#endif
+            logTransfer(transfer, "problem in creating directory %s: looking for a solution...\n", dir);
+            int parentDirLen = strlen(dir)-strlen(strrchr(dir,'\\'));
+            char *parentDir = (char*)calloc(parentDirLen+1, sizeof(char));
+            strncpy(parentDir, dir, parentDirLen);
+            if(createDirInClientSSH(transfer, parentDir)==0){
+                logTransfer(transfer, "back again to create dir %s\n", dir);
+                goto startCreateDirectoryAgain;
+            }
+            else{
+                logTransfer(transfer, "couldn't create parent directory %s\n", parentDir);
+                return -1;
+            }
+        }
+        else{
+            logTransfer(transfer, "directory already in local device %s\n", dir);
+            return 0;
+        }
+    }
+    logTransfer(transfer, "directory created => %s\n", dir);
+    return 0;
+}
+
+// file written with a temporary name and waiting for the next checkpoint (local file_dp or remote sftp_handle)
+typedef struct pendingFile_struct
+{
+    char *temporaryPath;
+    char *path;
+    FILE *file_dp;
+    LIBSSH2_SFTP *sftp_session;
+    LIBSSH2_SFTP_HANDLE *sftp_handle;
+    struct fanoutHost_struct *fanoutHost; // SSH remote device of the fan-out that wrote the file, NULL out of the fan-out
+    long long nbrBytes;
+    struct pendingFile_struct *nextPendingFile;
+}pendingFile_t;
+
+// count the file of the fan-out device as failed, its checkpoint failed (defined with the fan-out)
+static void failFanoutHostFile(struct fanoutHost_struct *host, long long nbrBytes);
+// the fan-out device was dropped as too slow, its session isn't used until the end of the run (defined with the fan-out)
+static int isFanoutHostLagging(struct fanoutHost_struct *host);
+
+static char *durabilityModeName(int mode){
+    switch(mode){
+        case DURABILITY_BATCH: return "batch";
+        case DURABILITY_STRICT: return "strict";
+        default: return "none";
+    }
+}
+
+static char *dedupModeName(int mode){
+    switch(mode){
+        case DEDUP_HARDLINK: return "hardlink";
+        case DEDUP_SYMLINK: return "symlink";
+        case DEDUP_REFLINK: return "reflink";
+        default: return "none";
+    }
+}
+
+static char *scheduleModeName(int mode){
+    switch(mode){
+        case SCHEDULE_LARGEST: return "largest";
+        case SCHEDULE_SMALLEST: return "smallest";
+        case SCHEDULE_MIXED: return "mixed";
+        default: return "walk";
+    }
+}
+
+// path where the file is written before the checkpoint (batch mode), the path itself otherwise (to free)
+static char *getTemporaryPath(sftpTransfer_t *transfer, char *path){
+    char *temporaryPath = (char*)calloc(strlen(path)+strlen(TEMPORARY_FILE_SUFFIX)+1, sizeof(char));
+    strcpy(temporaryPath, path);
+    if(transfer->durabilityMode==DURABILITY_BATCH){
+        strcat(temporaryPath, TEMPORARY_FILE_SUFFIX);
+    }
+    return temporaryPath;
+}
+
+// sync the file in the SSH client device
+static int syncFileClientSSH(sftpTransfer_t *transfer, FILE *file_dp){
+    fflush(file_dp);
+    transfer->runStats.nbrSyncs++;
+#ifdef WIN32
+    return _commit(_fileno(file_dp));
+#else
+    return fsync(fileno(file_dp));
+#endif
+}
+
+// sync the file in the SSH remote device (fsync@openssh.com extension). if the server doesn't support it, it's only a warning (return 0)
+static int syncFileRemoteSSH(sftpTransfer_t *transfer, LIBSSH2_SFTP *sftp, LIBSSH2_SFTP_HANDLE *sftp_handle){
+    if(!transfer->remoteSyncSupported){
+        return 0;
+    }
+    transfer->runStats.nbrSyncs++;
+    int err = libssh2_sftp_fsync(sftp_handle);
+    if(err<0){
+        if(err==LIBSSH2_ERROR_SFTP_PROTOCOL && libssh2_sftp_last_error(sftp)==LIBSSH2_FX_OP_UNSUPPORTED){
+            logTransfer(transfer, "worning, the SSH remote server doesn't support fsync, remote files are not synced!\n");
+            transfer->remoteSyncSupported = 0;
+            return 0;
+        }
+        logTransfer(transfer, "couldn't sync file in SSH remote device! error code: %d\n", err);
+        return -1;
+    }
+    return 0;
+}
+
+// rename file in the SSH client device, replace the destination if exist
+static int renameClientSSH(sftpTransfer_t *transfer, char *source, char *destination){
+#ifdef WIN32
+    if(!MoveFileEx(source, destination, MOVEFILE_REPLACE_EXISTING)){
+        logTransfer(transfer, "couldn't rename file %s to %s! error code: %lu\n", source, destination, (unsigned long)GetLastError());
+        return -1;
+    }
+#else
+    if(rename(source, destination)!=0){
+        logTransfer(transfer, "couldn't rename file %s to %s!\n", source, destination);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+// the rename failed because the destination exists (SFTP version 3 servers report it as a generic failure), and the source is still there
+static int isRenameTargetExistRemoteSSH(LIBSSH2_SFTP *sftp, char *source, char *destination){
+    LIBSSH2_SFTP_ATTRIBUTES attrs;
+    unsigned long sftpError = libssh2_sftp_last_error(sftp);
+    if(sftpError==LIBSSH2_FX_FILE_ALREADY_EXISTS){
+        return 1;
+    }
+    if(sftpError!=LIBSSH2_FX_FAILURE){
+        return 0;
+    }
+    return libssh2_sftp_lstat(sftp, source, &attrs)==0 && libssh2_sftp_lstat(sftp, destination, &attrs)==0;
+}
+
+// rename file in the SSH remote device, replace the destination if exist
+static int renameRemoteSSH(sftpTransfer_t *transfer, LIBSSH2_SFTP *sftp, char *source, char *destination){
+    int err;
+    err = libssh2_sftp_rename_ex(sftp, source, strlen(source), destination, strlen(destination), LIBSSH2_SFTP_RENAME_OVERWRITE|LIBSSH2_SFTP_RENAME_ATOMIC|LIBSSH2_SFTP_RENAME_NATIVE);
+    // SFTP version 3 servers (OpenSSH) ignore the overwrite flag and refuse to replace an existing file: remove it then rename again (not atomic).
+    // for any other failure the destination is kept
+    if(err==LIBSSH2_ERROR_SFTP_PROTOCOL && isRenameTargetExistRemoteSSH(sftp, source, destination)){
+        if(libssh2_sftp_unlink(sftp, destination)==0){
+            err = libssh2_sftp_rename_ex(sftp, source, strlen(source), destination, strlen(destination), LIBSSH2_SFTP_RENAME_OVERWRITE|LIBSSH2_SFTP_RENAME_ATOMIC|LIBSSH2_SFTP_RENAME_NATIVE);
+        }
+    }
+    if(err<0){
+        logTransfer(transfer, "couldn't rename file %s to %s in SSH remote device! error code: %d - %I32u\n", source, destination, err, libssh2_sftp_last_error(sftp));
+        return -1;
+    }
+    return 0;
+}
+
+// sync all the pending files then rename them in place (batch mode).
+// a file that can't be synced keeps the old destination (its temporary file is removed), each failed file is counted in the run errors
+// (and in the failed files of its device for the fan-out). the files of a lagging fan-out device wait for the end of the run.
+// return 0 if all the pending files are in place
+static int durabilityCheckpoint(sftpTransfer_t *transfer){
+    pendingFile_t *pendingFile;
+    int nbrLaggingFiles = 0;
+    for(pendingFile=transfer->listPendingFile; pendingFile!=NULL; pendingFile=pendingFile->nextPendingFile){
+        if(pendingFile->fanoutHost!=NULL && isFanoutHostLagging(pendingFile->fanoutHost)){
+            nbrLaggingFiles++;
+        }
+    }
+    if(transfer->nbrPendingFiles==nbrLaggingFiles){
+        return 0;
+    }
+    int nbrFailedFiles = 0;
+    double startTime = getTime();
+    logTransfer(transfer, "durability checkpoint: sync and rename %d files\n", transfer->nbrPendingFiles-nbrLaggingFiles);
+    pendingFile_t *listLaggingFile = NULL;
+#ifdef __linux__
+    // one syncfs syncs all the local files of the checkpoint, we keep a file descriptor to sync the renames too
+    int syncfsFd = -1;
+    int localSyncError = 0;
+    for(pendingFile=transfer->listPendingFile; pendingFile!=NULL; pendingFile=pendingFile->nextPendingFile){
+        if(pendingFile->file_dp!=NULL){
+            if(fflush(pendingFile->file_dp)!=0){
+                localSyncError = 1;
+            }
+            if(syncfsFd<0){
+                syncfsFd = dup(fileno(pendingFile->file_dp));
+            }
+        }
+    }
+    if(syncfsFd>=0){
+        // a syncfs error can't tell which file was lost, all the local files of the checkpoint fail
+        if(syncfs(syncfsFd)!=0){
+            logTransfer(transfer, "couldn't sync the local files of the checkpoint!\n");
+            localSyncError = 1;
+        }
+        transfer->runStats.nbrSyncs++;
+    }
+#endif
+    while((pendingFile=transfer->listPendingFile)!=NULL){
+        transfer->listPendingFile = pendingFile->nextPendingFile;
+        if(pendingFile->fanoutHost!=NULL && isFanoutHostLagging(pendingFile->fanoutHost)){
+            pendingFile->nextPendingFile = listLaggingFile;
+            listLaggingFile = pendingFile;
+            continue;
+        }
+        int error = 0;
+        if(pendingFile->file_dp!=NULL){
+#ifdef __linux__
+            error = localSyncError ? -1 : 0;
+#else
+            error = syncFileClientSSH(transfer, pendingFile->file_dp);
+#endif
+            if(fclose(pendingFile->file_dp)!=0){
+                error = -1;
+            }
+            if(error==0){
+                error = renameClientSSH(transfer, pendingFile->temporaryPath, pendingFile->path);
+            }
+            if(error!=0){
+                remove(pendingFile->temporaryPath);
+            }
+        }
+        else{
+            error = syncFileRemoteSSH(transfer, pendingFile->sftp_session, pendingFile->sftp_handle);
+            if(libssh2_sftp_close(pendingFile->sftp_handle)<0){
+                error = -1;
+            }
+            if(error==0){
+                error = renameRemoteSSH(transfer, pendingFile->sftp_session, pendingFile->temporaryPath, pendingFile->path);
+            }
+            if(error!=0){
+                libssh2_sftp_unlink(pendingFile->sftp_session, pendingFile->temporaryPath);
+            }
+        }
+        if(error!=0){
+            logTransfer(transfer, "durability checkpoint failed for %s, the destination is not replaced!\n", pendingFile->path);
+            transfer->runStats.nbrErrors++;
+            if(pendingFile->fanoutHost!=NULL){
+                failFanoutHostFile(pendingFile->fanoutHost, pendingFile->nbrBytes);
+            }
+            nbrFailedFiles++;
+        }
+        free(pendingFile->temporaryPath);
+        free(pendingFile->path);
+        free(pendingFile);
+    }
+#ifdef __linux__
+    if(syncfsFd>=0){
+        // sync the renames
+        if(syncfs(syncfsFd)!=0){
+            logTransfer(transfer, "couldn't sync the renames of the checkpoint!\n");
+            transfer->runStats.nbrErrors++;
+            nbrFailedFiles++;
+        }
+        transfer->runStats.nbrSyncs++;
+        close(syncfsFd);
+    }
+#endif
+    transfer->listPendingFile = listLaggingFile;
+    transfer->nbrPendingFiles = nbrLaggingFiles;
+    transfer->runStats.nbrCheckpoints++;
+    transfer->runStats.durabilityTime += getTime()-startTime;
+    return (nbrFailedFiles==0) ? 0 : -1;
+}
+
+// add a file to the pending files of the next checkpoint. the checkpoint is started by the transfer loop (walkTransfer) between two files,
+// never here: a file can be closed while other sessions are in non-blocking mode (fan-out)
+static void addPendingFile(sftpTransfer_t *transfer, char *temporaryPath, char *path, FILE *file_dp, LIBSSH2_SFTP *sftp, LIBSSH2_SFTP_HANDLE *sftp_handle){
+    pendingFile_t *pendingFile = (pendingFile_t*)malloc(sizeof(pendingFile_t));
+    pendingFile->temporaryPath = (char*)calloc(strlen(temporaryPath)+1, sizeof(char));
+    strcpy(pendingFile->temporaryPath, temporaryPath);
+    pendingFile->path = (char*)calloc(strlen(path)+1, sizeof(char));
+    strcpy(pendingFile->path, path);
+    pendingFile->file_dp = file_dp;
+    pendingFile->sftp_session = sftp;
+    pendingFile->sftp_handle = sftp_handle;
+    pendingFile->fanoutHost = NULL;
+    pendingFile->nbrBytes = 0;
+    pendingFile->nextPendingFile = transfer->listPendingFile;
+    transfer->listPendingFile = pendingFile;
+    transfer->nbrPendingFiles++;
+}
+
+// close the file written in the SSH client device based on the durability mode (on error, the temporary file is removed)
+static int closeFileClientSSH(sftpTransfer_t *transfer, FILE *file_dp, char *temporaryPath, char *destination, int error){
+    if(error!=0){
+        fclose(file_dp);
+        if(transfer->durabilityMode==DURABILITY_BATCH){
+            remove(temporaryPath);
+        }
+        return error;
+    }
+    if(transfer->durabilityMode==DURABILITY_BATCH){
+        addPendingFile(transfer, temporaryPath, destination, file_dp, NULL, NULL);
+        return 0;
+    }
+    if(transfer->durabilityMode==DURABILITY_STRICT){
+        double startTime = getTime();
+        if(syncFileClientSSH(transfer, file_dp)!=0){
+            logTransfer(transfer, "couldn't sync file %s!\n", destination);
+            error = -1;
+        }
+        transfer->runStats.durabilityTime += getTime()-startTime;
+    }
+    if(fclose(file_dp)!=0){
+        logTransfer(transfer, "couldn't close file %s!\n", destination);
+        error = -1;
+    }
+    return error;
+}
+
+// close the file written in the SSH remote device based on the durability mode (on error, the temporary file is removed)
+static int closeFileRemoteSSH(sftpTransfer_t *transfer, LIBSSH2_SFTP *sftp, LIBSSH2_SFTP_HANDLE *sftp_handle, char *temporaryPath, char *destination, int error){
+    if(error!=0){
+        libssh2_sftp_close(sftp_handle);
+        if(transfer->durabilityMode==DURABILITY_BATCH){
+            libssh2_sftp_unlink(sftp, temporaryPath);
+        }
+        return error;
+    }
+    if(transfer->durabilityMode==DURABILITY_BATCH){
+        addPendingFile(transfer, temporaryPath, destination, NULL, sftp, sftp_handle);
+        return 0;
+    }
+    if(transfer->durabilityMode==DURABILITY_STRICT){
+        double startTime = getTime();
+        if(syncFileRemoteSSH(transfer, sftp, sftp_handle)!=0){
+            logTransfer(transfer, "couldn't sync file %s!\n", destination);
+            error = -1;
+        }
+        transfer->runStats.durabilityTime += getTime()-startTime;
+    }
+    if(libssh2_sftp_close(sftp_handle)<0){
+        logTransfer(transfer, "couldn't close file %s!\n", destination);
+        error = -1;
+    }
+    return error;
+}
+
+// print the statistics of the run
+void printRunStats(sftpTransfer_t *transfer){
+    double elapsedTime = getTime()-transfer->runStats.startTime;
+    logTransfer(transfer, "run stats: %lld files, %lld directories, %lld errors, %lld bytes in %.3f s", transfer->runStats.nbrFiles, transfer->runStats.nbrDirectories, transfer->runStats.nbrErrors, transfer->runStats.nbrBytes, elapsedTime);
+    if(elapsedTime>0){
+        logTransfer(transfer, " (%.1f KB/s)", transfer->runStats.nbrBytes/1024.0/elapsedTime);
+    }
+    logTransfer(transfer, "\n");
+    logTransfer(transfer, "durability %s: %lld checkpoints, %lld syncs, %.3f s", durabilityModeName(transfer->durabilityMode), transfer->runStats.nbrCheckpoints, transfer->runStats.nbrSyncs, transfer->runStats.durabilityTime);
+    if(elapsedTime>0){
+        logTransfer(transfer, " (%.1f%% of the run)", 100.0*transfer->runStats.durabilityTime/elapsedTime);
+    }
+    logTransfer(transfer, "\n");
+    if(transfer->dedupMode!=DEDUP_NONE){
+        logTransfer(transfer, "dedup %s: %lld files created from a copy, %lld bytes saved\n", dedupModeName(transfer->dedupMode), transfer->runStats.nbrDedupFiles, transfer->runStats.nbrDedupBytes);
+    }
+    logTransfer(transfer, "schedule %s:", scheduleModeName(transfer->schedulePolicy));
+    if(transfer->runStats.firstFileTime>=0){
+        logTransfer(transfer, " first file done at %.3f s,", transfer->runStats.firstFileTime);
+    }
+    if(transfer->runStats.predictedTime>=0){
+        logTransfer(transfer, " predicted completion at %.3f s (predicted at %.3f s from %lld files listed, %s), actual %.3f s\n", transfer->runStats.predictedTime, transfer->runStats.predictionTime, transfer->runStats.predictionListedFiles, transfer->runStats.predictionWalkDone ? "walk done" : "walk not done, files listed later not included", elapsedTime);
+    }
+    else{
+        logTransfer(transfer, " completion at %.3f s (no prediction)\n", elapsedTime);
+    }
+}
+
+// upload file to the SSH remote server ("-" as source path means read the data from the data input). size is -1 if unknown
+static int uploadFile(sftpTransfer_t *transfer, char *fileFullPath, char *destination, long long size){
+    // open file source to make sure it's working, if it's not, exit the function without trying to create the file in the SSH remote side
+    logTransfer(transfer, "file source => %s\n", fileFullPath);
+    FILE *file_dp;
+    if(isStandardStreamPath(fileFullPath)){
+        file_dp = transfer->dataInput;
+#ifdef WIN32
+        // read the data input as binary data, not as text
+        _setmode(_fileno(file_dp), _O_BINARY);
+#endif
+    }
+    else{
+        file_dp = fopen(fileFullPath, "rb");
+    }
+    if(file_dp==NULL){
+        logTransfer(transfer, "problem with file source %s!\n", fileFullPath);
+        transfer->runStats.nbrErrors++;
+        return -1;
+    }
+
+    LIBSSH2_SFTP_HANDLE *sftp_handle=NULL;
+    // in batch durability mode the file is written with a temporary name
+    char *temporaryPath = getTemporaryPath(transfer, destination);
+    // open/create file with those options (flags): write, if not exist create it, if exist truncated to 0 length (mean empty the file).
+    sftp_handle = libssh2_sftp_open(transfer->sftp_session, temporaryPath, LIBSSH2_FXF_WRITE|LIBSSH2_FXF_CREAT|LIBSSH2_FXF_TRUNC, LIBSSH2_SFTP_S_IRWXU|LIBSSH2_SFTP_S_IRWXG|LIBSSH2_SFTP_S_IROTH);
+    if(sftp_handle==NULL){
+        logTransfer(transfer, "couldn't open or create file %s! error code: %I32u\n",temporaryPath, libssh2_sftp_last_error(transfer->sftp_session));
+        if(file_dp!=transfer->dataInput){
+            fclose(file_dp);
+        }
+        free(temporaryPath);
+        transfer->runStats.nbrErrors++;
+        return -1;
+    }
+
+    // read and upload the file block by block until the end of the source: the memory used doesn't depend on the file size
+    // and we don't need to know the size in advance, so the source could be a pipe.
+    int error = 0;
+    size_t totalUploaded = 0;
+    size_t nbrDataRead = 0;
+    char *uploadBuffer = (char*)malloc(TRANSFER_CHUNK_SIZE*sizeof(char));
+    while((nbrDataRead = fread(uploadBuffer, sizeof(char), TRANSFER_CHUNK_SIZE, file_dp))>0){
+        // libssh2_sftp_write could write less than what we asked, write the rest of the block
+        size_t nbrDataUploaded = 0;
+        while(nbrDataUploaded<nbrDataRead){
+            ssize_t nbrDataWritten = libssh2_sftp_write(sftp_handle, uploadBuffer+nbrDataUploaded, nbrDataRead-nbrDataUploaded);
+            if(nbrDataWritten<0){
+                logTransfer(transfer, "couldn't upload file %s to %s! error code: %d\n",fileFullPath, destination, (int)nbrDataWritten);
+                error = -1;
+                break;
+            }
+            nbrDataUploaded += nbrDataWritten;
+        }
+        if(error!=0){
+            break;
+        }
+        totalUploaded += nbrDataUploaded;
+        reportProgress(transfer, fileFullPath, destination, totalUploaded, size);
+    }
+    if(ferror(file_dp)){
+        logTransfer(transfer, "reading source file %s was failed!\n", fileFullPath);
+        error = -1;
+    }
+    free(uploadBuffer);
+    // close file and sftp handle
+    if(file_dp!=transfer->dataInput){
+        fclose(file_dp);
+    }
+    error = closeFileRemoteSSH(transfer, transfer->sftp_session, sftp_handle, temporaryPath, destination, error);
+    free(temporaryPath);
+    if(error==0){
+        logTransfer(transfer, "successfuly upload %zu bytes from source file %s to destination %s file.\n", totalUploaded, fileFullPath, destination);
+        transfer->runStats.nbrFiles++;
+        transfer->runStats.nbrBytes += totalUploaded;
+    }
+    else{
+        transfer->runStats.nbrErrors++;
+    }
+    return error;
+}
+
+// download file ("-" as destination path means write the data to the data output). size is -1 if unknown
+static int downloadFile(sftpTransfer_t *transfer, char *source, char *destination, long long size){
+    
+    // open file in read mode
+    logTransfer(transfer, "file source => %s\n", source);
+    LIBSSH2_SFTP_HANDLE *sftp_handle=NULL;
+    sftp_handle = libssh2_sftp_open(transfer->sftp_session, source, LIBSSH2_FXF_READ, 0);
+    if(sftp_handle==NULL){
+        logTransfer(transfer, "couldn't open source file %s! error code: %I32u\n",source, libssh2_sftp_last_error(transfer->sftp_session));
+        transfer->runStats.nbrErrors++;
+        return -1;
+    }
+    // open/create file in write and binary mode (in batch durability mode the file is written with a temporary name)
+    logTransfer(transfer, "file destination => %s\n", destination);
+    FILE *file_dp;
+    char *temporaryPath = getTemporaryPath(transfer, destination);
+    if(isStandardStreamPath(destination)){
+        file_dp = transfer->dataOutput;
+    }
+    else{
+        file_dp = fopen(temporaryPath, "wb");
+    }
+    if(file_dp==NULL){
+        logTransfer(transfer, "couldn't create file %s!\n", temporaryPath);
+        libssh2_sftp_close(sftp_handle);
+        free(temporaryPath);
+        transfer->runStats.nbrErrors++;
+        return -1;
+    }
+    // download the file block by block until the end of the source, the memory used doesn't depend on the file size
+    int error = 0;
+    size_t totalDownloaded = 0;
+    char *downloadBuffer = (char*)malloc(TRANSFER_CHUNK_SIZE*sizeof(char));
+    ssize_t bufferSize;
+    while((bufferSize = libssh2_sftp_read(sftp_handle, downloadBuffer, TRANSFER_CHUNK_SIZE))!=0){
+        if(bufferSize<0){
+            logTransfer(transfer, "couldn't read data from source file %s! error code: %I32u\n",source, libssh2_sftp_last_error(transfer->sftp_session));
+            error = -1;
+            break;
+        }
+        if(fwrite(downloadBuffer, sizeof(char), bufferSize, file_dp)!=(size_t)bufferSize){
+            logTransfer(transfer, "couldn't download all data from source file %s to destination file %s! error code: %d\n",source, destination, ferror(file_dp));
+            error = -1;
+            break;
+        }
+        totalDownloaded += bufferSize;
+        reportProgress(transfer, source, destination, totalDownloaded, size);
+    }
+    free(downloadBuffer);
+    // close file and sftp handle
+    if(isStandardStreamPath(destination)){
+        fflush(file_dp);
+    }
+    else{
+        error = closeFileClientSSH(transfer, file_dp, temporaryPath, destination, error);
+    }
+    free(temporaryPath);
+    libssh2_sftp_close(sftp_handle);
+    if(error==0){
+        logTransfer(transfer, "successfuly download %zu bytes from source file %s to destination %s file.\n", totalDownloaded, source, destination);
+        transfer->runStats.nbrFiles++;
+        transfer->runStats.nbrBytes += totalDownloaded;
+    }
+    else{
+        transfer->runStats.nbrErrors++;
+    }
+    return error;
+}
+
+// files already uploaded in dedup mode, by content hash
+typedef struct dedupEntry_struct
+{
+    unsigned long long hash;
+    long long size;
+    char *localPath;
+    char *remotePath;
+    struct dedupEntry_struct *nextDedupEntry;
+}dedupEntry_t;
+
+// compare the content of two files in the SSH client device. return 0 if they are the same
+static int compareFilesClientSSH(char *path1, char *path2){
+    FILE *file1_dp = fopen(path1, "rb");
+    FILE *file2_dp = fopen(path2, "rb");
+    int different = (file1_dp==NULL || file2_dp==NULL);
+    if(!different){
+        char *buffer1 = (char*)malloc(TRANSFER_CHUNK_SIZE*sizeof(char));
+        char *buffer2 = (char*)malloc(TRANSFER_CHUNK_SIZE*sizeof(char));
+        size_t nbrDataRead1, nbrDataRead2;
+        do{
+            nbrDataRead1 = fread(buffer1, sizeof(char), TRANSFER_CHUNK_SIZE, file1_dp);
+            nbrDataRead2 = fread(buffer2, sizeof(char), TRANSFER_CHUNK_SIZE, file2_dp);
+            if(nbrDataRead1!=nbrDataRead2 || memcmp(buffer1, buffer2, nbrDataRead1)!=0){
+                different = 1;
+                break;
+            }
+        } while(nbrDataRead1>0);
+        free(buffer1);
+        free(buffer2);
+    }
+    if(file1_dp!=NULL){
+        fclose(file1_dp);
+    }
+    if(file2_dp!=NULL){
+        fclose(file2_dp);
+    }
+    return different;
+}
+
+// find a file already uploaded with the same content, NULL if not found (or not dedup mode)
+static dedupEntry_t *findDedupEntry(sftpTransfer_t *transfer, sourcePath_t *sourcePath){
+    if(transfer->dedupMode==DEDUP_NONE || isStandardStreamPath(sourcePath->path)){
+        return NULL;
+    }
+    // the source path from the arguements is not from the walk, get its size and hash now
+    if(sourcePath->size<0){
+        getRegisterStatClientSSH(transfer, sourcePath->path, &sourcePath->size, NULL);
+    }
+    if(sourcePath->size<DEDUP_MIN_SIZE){
+        return NULL;
+    }
+    if(!sourcePath->hashed){
+        sourcePath->hashed = (hashFileClientSSH(transfer, sourcePath->path, &sourcePath->hash)==0);
+        if(!sourcePath->hashed){
+            return NULL;
+        }
+    }
+    dedupEntry_t *dedupEntry;
+    for(dedupEntry=transfer->dedupTable[sourcePath->hash%DEDUP_TABLE_SIZE]; dedupEntry!=NULL; dedupEntry=dedupEntry->nextDedupEntry){
+        // same hash and size, check the bytes so a hash collision never creates a wrong file
+        if(dedupEntry->hash==sourcePath->hash && dedupEntry->size==sourcePath->size && compareFilesClientSSH(dedupEntry->localPath, sourcePath->path)==0){
+            logTransfer(transfer, "%s has the same content as %s\n", sourcePath->path, dedupEntry->localPath);
+            return dedupEntry;
+        }
+    }
+    return NULL;
+}
+
+static void freeDedupTable(sftpTransfer_t *transfer){
+    if(transfer->dedupTable==NULL){
+        return;
+    }
+    int tablePos;
+    for(tablePos=0; tablePos<DEDUP_TABLE_SIZE; tablePos++){
+        while(transfer->dedupTable[tablePos]!=NULL){
+            dedupEntry_t *dedupEntry = transfer->dedupTable[tablePos];
+            transfer->dedupTable[tablePos] = dedupEntry->nextDedupEntry;
+            free(dedupEntry->localPath);
+            free(dedupEntry->remotePath);
+            free(dedupEntry);
+        }
+    }
+    free(transfer->dedupTable);
+    transfer->dedupTable = NULL;
+}
+
+// remember an uploaded file for the next files with the same content
+static void addDedupEntry(sftpTransfer_t *transfer, sourcePath_t *sourcePath, char *remotePath){
+    if(transfer->dedupMode==DEDUP_NONE || !sourcePath->hashed){
+        return;
+    }
+    dedupEntry_t *dedupEntry = (dedupEntry_t*)malloc(sizeof(dedupEntry_t));
+    dedupEntry->hash = sourcePath->hash;
+    dedupEntry->size = sourcePath->size;
+    dedupEntry->localPath = (char*)calloc(strlen(sourcePath->path)+1, sizeof(char));
+    strcpy(dedupEntry->localPath, sourcePath->path);
+    dedupEntry->remotePath = (char*)calloc(strlen(remotePath)+1, sizeof(char));
+    strcpy(dedupEntry->remotePath, remotePath);
+    dedupEntry->nextDedupEntry = transfer->dedupTable[sourcePath->hash%DEDUP_TABLE_SIZE];
+    transfer->dedupTable[sourcePath->hash%DEDUP_TABLE_SIZE] = dedupEntry;
+}
+
+// quote an arguement for the remote shell: 'arguement' with ' replaced by '\'' (to free)
+static char *quoteShellArgument(char *argument){
+    char *quotedArgument = (char*)calloc(strlen(argument)*4+3, sizeof(char));
+    char *quotedPos = quotedArgument;
+    *quotedPos++ = '\'';
+    for(; *argument!='\0'; argument++){
+        if(*argument=='\''){
+            strcpy(quotedPos, "'\\''");
+            quotedPos += 4;
+        }
+        else{
+            *quotedPos++ = *argument;
+        }
+    }
+    *quotedPos = '\'';
+    return quotedArgument;
+}
+
+// run a command in the SSH remote device over an exec channel. return the exit status of the command or -1
+static int execRemoteSSH(sftpTransfer_t *transfer, LIBSSH2_SESSION *session, char *command){
+    logTransfer(transfer, "exec in SSH remote device => %s\n", command);
+    LIBSSH2_CHANNEL *channel = libssh2_channel_open_session(session);
+    if(channel==NULL){
+        logTransfer(transfer, "couldn't open exec channel! error code: %d\n", libssh2_session_last_errno(session));
+        return -1;
+    }
+    if(libssh2_channel_exec(channel, command)!=0){
+        logTransfer(transfer, "couldn't exec command! error code: %d\n", libssh2_session_last_errno(session));
+        libssh2_channel_free(channel);
+        return -1;
+    }
+    char output[1024];
+    ssize_t nbrDataRead;
+    while((nbrDataRead = libssh2_channel_read(channel, output, sizeof(output)-1))>0){
+        output[nbrDataRead] = '\0';
+        logTransfer(transfer, "%s", output);
+    }
+    while((nbrDataRead = libssh2_channel_read_stderr(channel, output, sizeof(output)-1))>0){
+        output[nbrDataRead] = '\0';
+        logTransfer(transfer, "%s", output);
+    }
+    libssh2_channel_close(channel);
+    libssh2_channel_wait_closed(channel);
+    int exitStatus = libssh2_channel_get_exit_status(channel);
+    libssh2_channel_free(channel);
+    return exitStatus;
+}
+
+// check if the file is still written with its temporary name (batch durability mode)
+static int isPendingFile(sftpTransfer_t *transfer, char *path){
+    pendingFile_t *pendingFile;
+    for(pendingFile=transfer->listPendingFile; pendingFile!=NULL; pendingFile=pendingFile->nextPendingFile){
+        if(strcmp(pendingFile->path, path)==0){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// create the destination in the SSH remote device from the original file already uploaded (dedup mode). return 0 on success
+static int linkRemoteSSH(sftpTransfer_t *transfer, sshRemote_t *remote, char *original, char *destination){
+    // the original must be in place before we link to it
+    if(isPendingFile(transfer, original)){
+        durabilityCheckpoint(transfer);
+    }
+    char *quotedOriginal = quoteShellArgument(original);
+    char *quotedDestination = quoteShellArgument(destination);
+    char *command = (char*)calloc(strlen(quotedOriginal)+strlen(quotedDestination)+64, sizeof(char));
+    int error = 0;
+    if(transfer->dedupMode==DEDUP_HARDLINK){
+        sprintf(command, "ln -f -- %s %s", quotedOriginal, quotedDestination);
+        error = execRemoteSSH(transfer, remote->session, command);
+    }
+    else if(transfer->dedupMode==DEDUP_REFLINK){
+        sprintf(command, "cp --reflink=auto -f -- %s %s", quotedOriginal, quotedDestination);
+        error = execRemoteSSH(transfer, remote->session, command);
+    }
+    else if(transfer->dedupMode==DEDUP_SYMLINK){
+        // the target of a symbolic link is relative to the directory of the link, not to the working directory: link to the absolute path
+        char target[1024];
+        int targetLen = libssh2_sftp_realpath(remote->sftp_session, original, target, sizeof(target)-1);
+        if(targetLen<=0 || targetLen>=(int)sizeof(target)-1){
+            logTransfer(transfer, "couldn't get the absolute path of %s! error code: %d - %I32u\n", original, targetLen, libssh2_sftp_last_error(remote->sftp_session));
+            error = -1;
+        }
+        else{
+            target[targetLen] = '\0';
+            // the destination could exist from a previous run
+            libssh2_sftp_unlink(remote->sftp_session, destination);
+            error = libssh2_sftp_symlink(remote->sftp_session, target, destination);
+            if(error!=0){
+                logTransfer(transfer, "couldn't create symbolic link %s to %s! error code: %d - %I32u\n", destination, target, error, libssh2_sftp_last_error(remote->sftp_session));
+            }
+        }
+    }
+    free(command);
+    free(quotedOriginal);
+    free(quotedDestination);
+    if(error!=0){
+        logTransfer(transfer, "couldn't create %s from %s, upload it.\n", destination, original);
+        return -1;
+    }
+    logTransfer(transfer, "%s created from %s (%s)\n", destination, original, dedupModeName(transfer->dedupMode));
+    return 0;
+}
+
+// in hardlink and symlink dedup modes the destination could be a link from a previous run,
+// remove it so the upload doesn't write the data through the link into another file.
+// not in batch durability mode: the data goes to a temporary file whose rename replaces the link itself, and the old file
+// must stay in place until the checkpoint
+static void unlinkBeforeUploadRemoteSSH(sftpTransfer_t *transfer, LIBSSH2_SFTP *sftp, char *destination){
+    if(transfer->durabilityMode==DURABILITY_BATCH){
+        return;
+    }
+    if(transfer->dedupMode==DEDUP_HARDLINK || transfer->dedupMode==DEDUP_SYMLINK){
+        libssh2_sftp_unlink(sftp, destination);
+    }
+}
+
+// destination in the SSH remote server of a source path from the SSH client device (to free)
+static char *getUploadDestination(sftpTransfer_t *transfer, char *sourcePath){
+    // destination length is the sum of destinationPath length plus the absolut source directory length plus the difference between sourcepath and absolut source path 
+    int destinationLen = strlen(transfer->destinationPath)+strlen(strrchr(transfer->listSourcePath->path,'\\'))+(strlen(sourcePath)-strlen(transfer->listSourcePath->path));
+    char *destination =  (char*)calloc(destinationLen+1, sizeof(char));
+    strcpy(destination, transfer->destinationPath);
+    strcat(destination, strrchr(transfer->listSourcePath->path,'\\'));
+    strrchr(destination,'\\')[0] = '/'; // change the last separation symbol
+    unsigned int destination_pos = strlen(destination);
+    unsigned int string_pos = strlen(transfer->listSourcePath->path);
+    for(; string_pos<strlen(sourcePath); string_pos++){
+        if(sourcePath[string_pos]=='\\'){
+            destination[destination_pos]='/';
+        }
+        else{
+            destination[destination_pos]=sourcePath[string_pos];
+        }
+        destination_pos++;
+
+    }
+    destination[destination_pos]='\0';
+    return destination;
+}
+
+// create the parent directory of a file path in the SSH remote device
+static void createParentDirInRemoteSSH(sftpTransfer_t *transfer, LIBSSH2_SFTP *sftp, char *path){
+    char *parentSeparator = strrchr(path, '/');
+    if(parentSeparator!=NULL && parentSeparator!=path){
+        char *parentDir = (char*)calloc(parentSeparator-path+1, sizeof(char));
+        strncpy(parentDir, path, parentSeparator-path);
+        createDirInRemoteSSH(transfer, sftp, parentDir);
+        free(parentDir);
+    }
+}
+
+/*
+ * walk and dispatch loop shared by upload, download, relay and fan-out upload: the source path is the first entry, the next ones
+ * come from the walk. because the walk queues a parent directory before its content, the destination directory of an entry always exists.
+ *  + getDestination: destination of a source path (to free)
+ *  + createDir: create a destination directory, return 0 on success
+ *  + transferFile: transfer a file to its destination, return 0 on success (the function counts its own errors)
+ */
+static void walkTransfer(sftpTransfer_t *transfer, int remoteWalk, char *(*getDestination)(sftpTransfer_t*, char*), int (*createDir)(sftpTransfer_t*, char*), int (*transferFile)(sftpTransfer_t*, sourcePath_t*, char*)){
+    walker_t walker;
+    memset(&walker, 0, sizeof(walker_t));
+    if(transfer->listSourcePath->type==DIRECTORY_TYPE){
+        startWalk(transfer, &walker, transfer->listSourcePath->path, remoteWalk, (transfer->options&OPTION_REC_MASK)==OPTION_REC);
+    }
+    sourcePath_t *sourcePath = transfer->listSourcePath;
+    while(sourcePath!=NULL){
+        char *destination = getDestination(transfer, sourcePath->path);
+        logTransfer(transfer, "file destination => %s\n", destination);
+        int error = 0;
+        if(sourcePath->type==DIRECTORY_TYPE){
+            error = createDir(transfer, destination);
+            if(error==0){
+                transfer->runStats.nbrDirectories++;
+            }
+            else{
+                transfer->runStats.nbrErrors++;
+            }
+        }
+        else if(sourcePath->type==FILE_TYPE){
+            error = transferFile(transfer, sourcePath, destination);
+        }
+        reportCompletion(transfer, sourcePath->path, destination, sourcePath->type, error);
+        free(destination);
+        if(sourcePath!=transfer->listSourcePath){
+            freeSourcePath(sourcePath);
+        }
+        // sync and rename the pending files (batch durability mode), all the sessions are back in blocking mode between two files
+        if(transfer->nbrPendingFiles>=DURABILITY_BATCH_FILES){
+            durabilityCheckpoint(transfer);
+        }
+        sourcePath = nextWalkSourcePath(transfer, &walker);
+    }
+    stopWalk(transfer, &walker);
+    // sync and rename the last files (batch durability mode)
+    durabilityCheckpoint(transfer);
+}
+
+static int createDirUpload(sftpTransfer_t *transfer, char *dir){
+    return createDirInRemoteSSH(transfer, transfer->sftp_session, dir);
+}
+
+// upload a file of the walk. in dedup mode, a content already uploaded is created from its first copy in the SSH remote server
+static int uploadSourcePath(sftpTransfer_t *transfer, sourcePath_t *sourcePath, char *destination){
+    dedupEntry_t *dedupEntry = findDedupEntry(transfer, sourcePath);
+    if(dedupEntry!=NULL && linkRemoteSSH(transfer, &transfer->remoteSSH, dedupEntry->remotePath, destination)==0){
+        transfer->runStats.nbrFiles++;
+        transfer->runStats.nbrDedupFiles++;
+        transfer->runStats.nbrDedupBytes += sourcePath->size;
+        return 0;
+    }
+    unlinkBeforeUploadRemoteSSH(transfer, transfer->sftp_session, destination);
+    int error = uploadFile(transfer, sourcePath->path, destination, sourcePath->size);
+    if(error==0){
+        addDedupEntry(transfer, sourcePath, destination);
+    }
+    return error;
+}
+
+// upload section
+static void upload(sftpTransfer_t *transfer){
+    logTransfer(transfer, "start upload\n");
+    // the standard input is streamed to the destination path, which is the full path of the file in the SSH remote server
+    if(isStandardStreamPath(transfer->listSourcePath->path)){
+        createParentDirInRemoteSSH(transfer, transfer->sftp_session, transfer->destinationPath);
+        int error = uploadFile(transfer, transfer->listSourcePath->path, transfer->destinationPath, -1);
+        durabilityCheckpoint(transfer);
+        reportCompletion(transfer, transfer->listSourcePath->path, transfer->destinationPath, FILE_TYPE, error);
+        return;
+    }
+    // attempt to create the destination directory if not existe.
+    if (createDirInRemoteSSH(transfer, transfer->sftp_session, transfer->destinationPath)!=0){
+        logTransfer(transfer, "could create destination path\n");
+        transfer->runStats.nbrErrors++;
+        return;
+    }
+    walkTransfer(transfer, 0, getUploadDestination, createDirUpload, uploadSourcePath);
+}
+
+// destination in the SSH client device of a source path from the SSH remote device (to free)
+static char *getDownloadDestination(sftpTransfer_t *transfer, char *sourcePath){
+    // destination length is the sum of destinationPath length plus the absolut source directory length plus the difference between sourcepath and absolut source path 
+    int destinationLen = strlen(transfer->destinationPath)+strlen(strrchr(transfer->listSourcePath->path,'/'))+(strlen(sourcePath)-strlen(transfer->listSourcePath->path));
+    char *destination =  (char*)calloc(destinationLen+1, sizeof(char));
+    strcpy(destination, transfer->destinationPath);
+    strcat(destination, strrchr(transfer->listSourcePath->path,'/'));
+    strrchr(destination,'/')[0] = '\\'; // change the last separation symbol
+    unsigned int destination_pos = strlen(destination);
+    unsigned int string_pos = strlen(transfer->listSourcePath->path);
+    for(; string_pos<strlen(sourcePath); string_pos++){
+        if(sourcePath[string_pos]=='/'){
+            destination[destination_pos]='\\';
+        }
+        else{
+            destination[destination_pos]=sourcePath[string_pos];
+        }
+        destination_pos++;
+    }
+    destination[destination_pos]='\0';
+    return destination;
+}
+
+static int downloadSourcePath(sftpTransfer_t *transfer, sourcePath_t *sourcePath, char *destination){
+    return downloadFile(transfer, sourcePath->path, destination, sourcePath->size);
+}
+
+// download section
+static void download(sftpTransfer_t *transfer){
+    logTransfer(transfer, "start download\n");
+    // the source file is streamed to the standard output
+    if(isStandardStreamPath(transfer->destinationPath)){
+        int error = downloadFile(transfer, transfer->listSourcePath->path, transfer->destinationPath, -1);
+        reportCompletion(transfer, transfer->listSourcePath->path, transfer->destinationPath, FILE_TYPE, error);
+        return;
+    }
+    // attempt to create the destination directory if not existe.
+    if (createDirInClientSSH(transfer, transfer->destinationPath)!=0){
+        logTransfer(transfer, "could create destination path\n");
+        transfer->runStats.nbrErrors++;
+        return;
+    }
+    walkTransfer(transfer, 1, getDownloadDestination, createDirInClientSSH, downloadSourcePath);
+}
+
+
+/*
+ * relay file from the SSH remote device to the relay SSH remote device.
+ * the data never touch the local disk, it goes through a ring of RELAY_RING_SLOTS buffers:
+ * the read side (remoteSSH) fills the free slots while the write side (relaySSH) empties the filled slots.
+ * both sessions are switched to non-blocking mode during the transfer so a slow side doesn't stop the other one,
+ * and when both sides would block we wait on the two sockets.
+ */
+static int relayFile(sftpTransfer_t *transfer, char *source, char *destination, long long size){
+    logTransfer(transfer, "relay file %s => %s\n", source, destination);
+    LIBSSH2_SFTP_HANDLE *source_handle = libssh2_sftp_open(transfer->remoteSSH.sftp_session, source, LIBSSH2_FXF_READ, 0);
+    if(source_handle==NULL){
+        logTransfer(transfer, "couldn't open source file %s! error code: %I32u\n", source, libssh2_sftp_last_error(transfer->remoteSSH.sftp_session));
+        transfer->runStats.nbrErrors++;
+        return -1;
+    }
+    // in batch durability mode the file is written with a temporary name
+    char *temporaryPath = getTemporaryPath(transfer, destination);
+    // open/create file with those options (flags): write, if not exist create it, if exist truncated to 0 length (mean empty the file).
+    LIBSSH2_SFTP_HANDLE *destination_handle = libssh2_sftp_open(transfer->relaySSH.sftp_session, temporaryPath, LIBSSH2_FXF_WRITE|LIBSSH2_FXF_CREAT|LIBSSH2_FXF_TRUNC, LIBSSH2_SFTP_S_IRWXU|LIBSSH2_SFTP_S_IRWXG|LIBSSH2_SFTP_S_IROTH);
+    if(destination_handle==NULL){
+        logTransfer(transfer, "couldn't open or create file %s! error code: %I32u\n", temporaryPath, libssh2_sftp_last_error(transfer->relaySSH.sftp_session));
+        libssh2_sftp_close(source_handle);
+        free(temporaryPath);
+        transfer->runStats.nbrErrors++;
+        return -1;
+    }
+    char *ring = (char*)malloc(RELAY_RING_SLOTS*TRANSFER_CHUNK_SIZE*sizeof(char));
+    size_t slotLen[RELAY_RING_SLOTS];
+    unsigned int readSlot = 0; // next slot to fill from the source
+    unsigned int writeSlot = 0; // next slot to send to the destination
+    unsigned int nbrFilledSlots = 0;
+    size_t writeSlotOffset = 0; // data of the write slot already sent
+    size_t totalRelayed = 0;
+    int sourceEOF = 0;
+    int error = 0;
+    sshRemote_t *remotes[2] = {&transfer->remoteSSH, &transfer->relaySSH};
+    libssh2_session_set_blocking(transfer->remoteSSH.session, 0);
+    libssh2_session_set_blocking(transfer->relaySSH.session, 0);
+    while(sourceEOF==0 || nbrFilledSlots>0){
+        int readWouldBlock = 1;
+        int writeWouldBlock = 1;
+        // fill a free slot from the source
+        if(sourceEOF==0 && nbrFilledSlots<RELAY_RING_SLOTS){
+            ssize_t nbrDataRead = libssh2_sftp_read(source_handle, ring+readSlot*TRANSFER_CHUNK_SIZE, TRANSFER_CHUNK_SIZE);
+            if(nbrDataRead>0){
+                slotLen[readSlot] = nbrDataRead;
+                readSlot = (readSlot+1)%RELAY_RING_SLOTS;
+                nbrFilledSlots++;
+                readWouldBlock = 0;
+            }
+            else if(nbrDataRead==0){
+                sourceEOF = 1;
+                readWouldBlock = 0;
+            }
+            else if(nbrDataRead!=LIBSSH2_ERROR_EAGAIN){
+                logTransfer(transfer, "couldn't read data from source file %s! error code: %d\n", source, (int)nbrDataRead);
+                error = -1;
+                break;
+            }
+        }
+        // empty a filled slot to the destination
+        if(nbrFilledSlots>0){
+            ssize_t nbrDataWritten = libssh2_sftp_write(destination_handle, ring+writeSlot*TRANSFER_CHUNK_SIZE+writeSlotOffset, slotLen[writeSlot]-writeSlotOffset);
+            if(nbrDataWritten>0){
+                writeSlotOffset += nbrDataWritten;
+                totalRelayed += nbrDataWritten;
+                if(writeSlotOffset==slotLen[writeSlot]){
+                    writeSlot = (writeSlot+1)%RELAY_RING_SLOTS;
+                    nbrFilledSlots--;
+                    writeSlotOffset = 0;
+                    reportProgress(transfer, source, destination, totalRelayed, size);
+                }
+                writeWouldBlock = 0;
+            }
+            else if(nbrDataWritten!=LIBSSH2_ERROR_EAGAIN){
+                logTransfer(transfer, "couldn't write data to destination file %s! error code: %d\n", destination, (int)nbrDataWritten);
+                error = -1;
+                break;
+            }
+        }
+        // no side could progress, wait for one of the sockets
+        if(readWouldBlock && writeWouldBlock){
+            waitSocketRemoteSSH(remotes, 2);
+        }
+    }
+    libssh2_session_set_blocking(transfer->remoteSSH.session, 1);
+    libssh2_session_set_blocking(transfer->relaySSH.session, 1);
+    free(ring);
+    libssh2_sftp_close(source_handle);
+    error = closeFileRemoteSSH(transfer, transfer->relaySSH.sftp_session, destination_handle, temporaryPath, destination, error);
+    free(temporaryPath);
+    if(error==0){
+        logTransfer(transfer, "successfuly relay %zu bytes from source file %s to destination %s file.\n", totalRelayed, source, destination);
+        transfer->runStats.nbrFiles++;
+        transfer->runStats.nbrBytes += totalRelayed;
+    }
+    else{
+        transfer->runStats.nbrErrors++;
+    }
+    return error;
+}
+
+// destination in the relay SSH remote device of a source path from the SSH remote device (to free).
+// both sides are SSH remote devices so both use '/' as separator
+static char *getRelayDestination(sftpTransfer_t *transfer, char *sourcePath){
+    char *sourceName = strrchr(transfer->listSourcePath->path, '/');
+    sourceName = (sourceName==NULL) ? transfer->listSourcePath->path : sourceName+1;
+    // destination is the destinationPath plus the source name plus the difference between sourcepath and absolut source path
+    char *destination = (char*)calloc(strlen(transfer->destinationPath)+2+strlen(sourceName)+strlen(sourcePath)-strlen(transfer->listSourcePath->path)+1, sizeof(char));
+    sprintf(destination, "%s/%s%s", transfer->destinationPath, sourceName, sourcePath+strlen(transfer->listSourcePath->path));
+    return destination;
+}
+
+static int createDirRelay(sftpTransfer_t *transfer, char *dir){
+    return createDirInRemoteSSH(transfer, transfer->relaySSH.sftp_session, dir);
+}
+
+static int relaySourcePath(sftpTransfer_t *transfer, sourcePath_t *sourcePath, char *destination){
+    return relayFile(transfer, sourcePath->path, destination, sourcePath->size);
+}
+
+// relay section: mirror the source path from the SSH remote device to the relay SSH remote device
+static void relay(sftpTransfer_t *transfer){
+    logTransfer(transfer, "start relay\n");
+    // attempt to create the destination directory if not existe.
+    if (createDirInRemoteSSH(transfer, transfer->relaySSH.sftp_session, transfer->destinationPath)!=0){
+        logTransfer(transfer, "could create destination path\n");
+        transfer->runStats.nbrErrors++;
+        return;
+    }
+    walkTransfer(transfer, 1, getRelayDestination, createDirRelay, relaySourcePath);
+}
+
+// connect to the SSH remote device: create the socket, the SSH session, authenticate and establish the SFTP session
+static int connectRemoteSSH(sftpTransfer_t *transfer, sshRemote_t *remote){
+    int err;
+    // Prepare socket for TCP/IP
+    // AF_INET for IPv4; SOCK_STREAM for the type of the socket that supports the TCP protocol; 0 (or IPPROTO_TCP) for TCP protocol
+    logTransfer(transfer, "Create socket for %s.\n", remote->ip);
+    remote->socket = socket(AF_INET, SOCK_STREAM, 0);
+#ifdef WIN32
+    if(remote->socket == INVALID_SOCKET){
+        logTransfer(transfer, "Failed to create socket! code error: %d\n", WSAGetLastError());
+        return -1;
+    }
+#endif
+    // connect to the remote server
+    remote->sockaddr_in.sin_family = AF_INET;
+    remote->sockaddr_in.sin_port = htons(remote->port);
+    remote->sockaddr_in.sin_addr.s_addr = inet_addr(remote->ip);
+    err = connect(remote->socket, (struct sockaddr*)(&remote->sockaddr_in), sizeof(struct sockaddr_in));
+    if(err != 0){
+        logTransfer(transfer, "Failed to connect to remote server! code error: %d\n", err);
+        goto exitConnectFromSocket;
+    }
+
+    // Create session
+    logTransfer(transfer, "Create SSH2 session.\n");
+    remote->session = libssh2_session_init();
+    if(remote->session == NULL){
+        logTransfer(transfer, "Failed to create SSH session! code error (%d).\n", err);
+        goto exitConnectFromSocket;
+    }
+
+    // trace: for debugging.
+#ifdef LIBSSH2DEBUG
+    libssh2_trace(remote->session, LIBSSH2_TRACE_SOCKET|LIBSSH2_TRACE_TRANS|LIBSSH2_TRACE_KEX|LIBSSH2_TRACE_AUTH|LIBSSH2_TRACE_CONN|LIBSSH2_TRACE_SFTP|LIBSSH2_TRACE_ERROR|LIBSSH2_TRACE_PUBLICKEY);
+    // the trace goes to the log of the transfer
+    libssh2_trace_sethandler(remote->session, transfer, traceTransfer);
+#endif
+
+    // Begin negotiation with remote server
+    // This is a transport layer negotiation where client and remote server (host) exchange keys, setup the crypto, compression and MAC layers
+    logTransfer(transfer, "Start the handshake with Remote server.\n");
+    err = libssh2_session_handshake(remote->session, remote->socket);
+    if(err != 0){
+        logTransfer(transfer, "Failed to negotiate with Remote server! code error (%d).\n", err);
+        goto exitConnectFromSession;
+    }
+
+    // Get a list of the authentication methods are available by the host.
+    logTransfer(transfer, "Get the list of authentication methods from the Remote server.\n");
+    char *listAuth = libssh2_userauth_list(remote->session, remote->userName, strlen(remote->userName));
+    logTransfer(transfer, "    list: %s\n", listAuth);
+    if(listAuth == NULL){
+        logTransfer(transfer, "No authentication method was detected.\n");
+        goto exitConnectFromSession;
+    }
+
+    // Start authentication
+    logTransfer(transfer, "Select authentication method.\n");
+    if((strstr(listAuth,"publickey")!=NULL) && (remote->authMethod==OPTION_AUTH_PUBKEY)){
+        logTransfer(transfer, "Start public key authentication method.\n");
+        err = libssh2_userauth_publickey_fromfile(remote->session, remote->userName, remote->publicKeyPath, remote->privateKeyPath, remote->password);
+        if(err != 0){
+            logTransfer(transfer, "Authentication error. error code: %d\n", err);
+            if(err==LIBSSH2_ERROR_AUTHENTICATION_FAILED){
+                logTransfer(transfer, "    =>public key was not accepted\n");
+            }
+            else if(err==LIBSSH2_ERROR_PUBLICKEY_UNVERIFIED){
+                logTransfer(transfer, "    =>invalid username or public key\n");
+            }
+            else if(err==LIBSSH2_ERROR_EAGAIN){
+                logTransfer(transfer, "    =>not a real failure.\n");
+            }
+            goto exitConnectFromSession;
+        }
+    }
+    else if((strstr(listAuth,"password")!=NULL) && (remote->authMethod==OPTION_AUTH_PASSWORD)){
+        logTransfer(transfer, "Start password authentication method.\n");
+        err = libssh2_userauth_password(remote->session, remote->userName, remote->password);
+        if(err != 0){
+            logTransfer(transfer, "Authentication error. error code: %d\n", err);
+            if(err==LIBSSH2_ERROR_AUTHENTICATION_FAILED){
+                logTransfer(transfer, "    =>invalid username or password\n");
+            }
+            else if(err==LIBSSH2_ERROR_EAGAIN){
+                logTransfer(transfer, "    =>not a real failure.\n");
+            }
+            goto exitConnectFromSession;
+        }
+    }
+    else{
+        logTransfer(transfer, "Not supported authentication method.\n");
+        goto exitConnectFromSession;
+    }
+
+    // Open/Establish SFTP session
+    remote->sftp_session = libssh2_sftp_init(remote->session);
+    if(remote->sftp_session == NULL){
+        logTransfer(transfer, "couldn't init SFTP session!\n");
+        goto exitConnectFromSession;
+    }
+
+    /*
+    * Meaning of blocking.
+    * Set or clear blocking mode on the selected on the session. This will instantly affect any channels associated with this session.
+    *  If a read is performed on a session with no data currently available:
+    *   A blocking session will wait for data to arrive and return what it receives.
+    *   A non-blocking session will return immediately with an empty buffer.
+    *  If a write is performed on a session with no room for more data:
+    *   A blocking session will wait for room.
+    *   A non-blocking session will return immediately without writing anything.
+    */
+
+    // we wil use the blocking session mode to make sure to write the data to the SSH remote.
+    libssh2_session_set_blocking(remote->session, 1);
+    return 0;
+
+    exitConnectFromSession:
+    libssh2_session_disconnect(remote->session, "Shutdown system.");
+    libssh2_session_free(remote->session);
+    remote->session = NULL;
+    exitConnectFromSocket:
+#ifdef WIN32
+    closesocket(remote->socket);
+#else
+    close(remote->socket);
+#endif
+    return -1;
+}
+
+// close the SFTP session, the SSH session and the socket of the SSH remote device
+static void disconnectRemoteSSH(sshRemote_t *remote){
+    if(remote->sftp_session != NULL){
+        libssh2_sftp_shutdown(remote->sftp_session);
+        remote->sftp_session = NULL;
+    }
+    if(remote->session != NULL){
+        libssh2_session_disconnect(remote->session, "Shutdown system.");
+        libssh2_session_free(remote->session);
+        remote->session = NULL;
+#ifdef WIN32
+        closesocket(remote->socket);
+#else
+        close(remote->socket);
+#endif
+    }
+}
+
+/*
+ * fan-out upload (-ip <ip1>,<ip2>,...): the source tree is walked once and each file is read once, then every block is
+ * sent to all the SSH remote devices. the blocks are shared between the devices with a reference counter, a block is freed
+ * when all the devices have written it.
+ * each device can be up to FANOUT_HOST_WINDOW blocks ahead of the slowest one. when the slowest device has a full window
+ * the reading waits for it (backpressure). a device is dropped from the fan-out of the current file (the file fails for this device only)
+ * so it doesn't stall the others:
+ *  + when it holds back the others: its window is full while another device has written everything and waits for the next block.
+ *    the time it holds back the others is added up during the file, after fanoutLagTimeout seconds it's dropped.
+ *  + when it doesn't write anything for fanoutStallTimeout seconds while it has blocks to write (full window or not, before or
+ *    after the end of the source file). the time waiting for the next block of the source doesn't count.
+ * a device dropped as too slow is lagging: it's skipped for the rest of the run (its files and directories fail) and its file is
+ * closed in non-blocking mode while the others go on, so it never blocks them. at the end of the run it gets fanoutStallTimeout
+ * seconds to finish, then it's back for the last checkpoint, or it's disconnected and its pending files fail.
+ * all the devices use the same port and credentials. per device results are printed at the end.
+ */
+#define FANOUT_HOST_WINDOW 16
+// block of data shared by the SSH remote devices
+typedef struct fanoutChunk_struct
+{
+    size_t length;
+    int refCount;
+    char data[TRANSFER_CHUNK_SIZE];
+}fanoutChunk_t;
+typedef struct fanoutHost_struct
+{
+    sshRemote_t remote;
+    int connected;
+    // current file
+    int inFile; // the device is part of the fan-out of the current file
+    LIBSSH2_SFTP_HANDLE *sftp_handle;
+    fanoutChunk_t *window[FANOUT_HOST_WINDOW]; // blocks waiting to be written, the oldest first
+    int windowHead;
+    int windowLength;
+    size_t chunkOffset; // data of the oldest block already written
+    double lastProgressTime;
+    double holdBackTime; // seconds the device has held back the others during the current file
+    size_t fileBytes;
+    // dropped as too slow, the session stays in non-blocking mode until the end of the run
+    int lagging;
+    LIBSSH2_SFTP_HANDLE *laggingHandle; // file of the drop, still to close
+    char *laggingPath; // temporary file of the drop, still to remove (batch mode)
+    // results
+    long long nbrFiles;
+    long long nbrFailedFiles;
+    long long nbrDirectories;
+    long long nbrFailedDirectories;
+    long long nbrBytes;
+    long long nbrDrops; // files dropped because the device was too slow
+}fanoutHost_t;
+
+static void disconnectFanoutHosts(sftpTransfer_t *transfer){
+    int hostPos;
+    for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+        if(transfer->fanoutHosts[hostPos].connected){
+            disconnectRemoteSSH(&transfer->fanoutHosts[hostPos].remote);
+            transfer->fanoutHosts[hostPos].connected = 0;
+        }
+    }
+}
+
+static void freeFanoutHosts(sftpTransfer_t *transfer){
+    int hostPos;
+    for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+        free(transfer->fanoutHosts[hostPos].remote.ip);
+    }
+    free(transfer->fanoutHosts);
+    transfer->fanoutHosts = NULL;
+    transfer->nbrFanoutHosts = 0;
+}
+
+// split the ip list of the -ip option, all the SSH remote devices use the same port and credentials as remoteSSH.
+// the list is built again at each connection, so a context connected again doesn't get the devices twice
+static void prepareFanoutHosts(sftpTransfer_t *transfer){
+    disconnectFanoutHosts(transfer);
+    freeFanoutHosts(transfer);
+    if(transfer->remoteSSH.ip==NULL || strchr(transfer->remoteSSH.ip, ',')==NULL){
+        return;
+    }
+    char *ipList = (char*)calloc(strlen(transfer->remoteSSH.ip)+1, sizeof(char));
+    strcpy(ipList, transfer->remoteSSH.ip);
+    // split by hand, strtok keeps its position in a global
+    char *ip = ipList;
+    char *nextIp;
+    for(; ip!=NULL; ip=nextIp){
+        nextIp = strchr(ip, ',');
+        if(nextIp!=NULL){
+            *nextIp++ = '\0';
+        }
+        if(strcmp(ip, "")==0){
+            continue;
+        }
+        transfer->fanoutHosts = (fanoutHost_t*)realloc(transfer->fanoutHosts, (transfer->nbrFanoutHosts+1)*sizeof(fanoutHost_t));
+        memset(&transfer->fanoutHosts[transfer->nbrFanoutHosts], 0, sizeof(fanoutHost_t));
+        transfer->fanoutHosts[transfer->nbrFanoutHosts].remote = transfer->remoteSSH;
+        transfer->fanoutHosts[transfer->nbrFanoutHosts].remote.ip = (char*)calloc(strlen(ip)+1, sizeof(char));
+        strcpy(transfer->fanoutHosts[transfer->nbrFanoutHosts].remote.ip, ip);
+        transfer->nbrFanoutHosts++;
+    }
+    free(ipList);
+    logTransfer(transfer, "fan-out to %d SSH remote devices\n", transfer->nbrFanoutHosts);
+}
+
+// connect to all the SSH remote devices of the fan-out. return the number of connected devices
+static int connectFanoutHosts(sftpTransfer_t *transfer){
+    int nbrConnected = 0;
+    int hostPos;
+    for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+        if(connectRemoteSSH(transfer, &transfer->fanoutHosts[hostPos].remote)==0){
+            transfer->fanoutHosts[hostPos].connected = 1;
+            nbrConnected++;
+        }
+        else{
+            logTransfer(transfer, "couldn't connect to %s, it's removed from the fan-out.\n", transfer->fanoutHosts[hostPos].remote.ip);
+        }
+    }
+    return nbrConnected;
+}
+
+// release the oldest block of the window of the SSH remote device
+static void releaseFanoutChunk(fanoutHost_t *host){
+    fanoutChunk_t *chunk = host->window[host->windowHead];
+    chunk->refCount--;
+    if(chunk->refCount==0){
+        free(chunk);
+    }
+    host->windowHead = (host->windowHead+1)%FANOUT_HOST_WINDOW;
+    host->windowLength--;
+    host->chunkOffset = 0;
+}
+
+// go on closing the file of the lagging SSH remote device without waiting for it. return 1 when it's done
+static int finishLaggingFanoutHost(fanoutHost_t *host){
+    if(host->laggingHandle!=NULL){
+        if(libssh2_sftp_close(host->laggingHandle)==LIBSSH2_ERROR_EAGAIN){
+            return 0;
+        }
+        host->laggingHandle = NULL;
+    }
+    if(host->laggingPath!=NULL){
+        if(libssh2_sftp_unlink(host->remote.sftp_session, host->laggingPath)==LIBSSH2_ERROR_EAGAIN){
+            return 0;
+        }
+        free(host->laggingPath);
+        host->laggingPath = NULL;
+    }
+    return 1;
+}
+
+// remove the SSH remote device from the fan-out of the current file. a device with an error is closed at once,
+// a device too slow becomes lagging: its file is closed in the background and it's skipped for the rest of the run
+static void dropFanoutHost(sftpTransfer_t *transfer, fanoutHost_t *host, char *temporaryPath, int lagging){
+    while(host->windowLength>0){
+        releaseFanoutChunk(host);
+    }
+    host->inFile = 0;
+    host->nbrFailedFiles++;
+    if(lagging){
+        host->lagging = 1;
+        host->laggingHandle = host->sftp_handle;
+        if(transfer->durabilityMode==DURABILITY_BATCH){
+            host->laggingPath = (char*)calloc(strlen(temporaryPath)+1, sizeof(char));
+            strcpy(host->laggingPath, temporaryPath);
+        }
+        finishLaggingFanoutHost(host);
+    }
+    else{
+        libssh2_session_set_blocking(host->remote.session, 1);
+        closeFileRemoteSSH(transfer, host->remote.sftp_session, host->sftp_handle, temporaryPath, NULL, -1);
+        libssh2_session_set_blocking(host->remote.session, 0);
+    }
+    host->sftp_handle = NULL;
+}
+
+static int isFanoutHostLagging(fanoutHost_t *host){
+    return host->lagging;
+}
+
+// end of the run: give the lagging SSH remote devices fanoutStallTimeout seconds to close their file, then they are back in blocking
+// mode for the last checkpoint. a device that doesn't answer is disconnected and its pending files fail
+static void finishLaggingFanoutHosts(sftpTransfer_t *transfer){
+    int hostPos;
+    for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+        fanoutHost_t *host = &transfer->fanoutHosts[hostPos];
+        if(!host->lagging){
+            continue;
+        }
+        double startTime = getTime();
+        sshRemote_t *remote = &host->remote;
+        int done;
+        while(!(done=finishLaggingFanoutHost(host)) && getTime()-startTime<=transfer->fanoutStallTimeout){
+            waitSocketRemoteSSH(&remote, 1);
+        }
+        host->lagging = 0;
+        if(done){
+            libssh2_session_set_blocking(host->remote.session, 1);
+            continue;
+        }
+        logTransfer(transfer, "%s doesn't answer, disconnected\n", host->remote.ip);
+        pendingFile_t **pendingFilePtr = &transfer->listPendingFile;
+        while(*pendingFilePtr!=NULL){
+            pendingFile_t *pendingFile = *pendingFilePtr;
+            if(pendingFile->fanoutHost!=host){
+                pendingFilePtr = &pendingFile->nextPendingFile;
+                continue;
+            }
+            logTransfer(transfer, "durability checkpoint failed for %s in %s, the destination is not replaced!\n", pendingFile->path, host->remote.ip);
+            transfer->runStats.nbrErrors++;
+            failFanoutHostFile(host, pendingFile->nbrBytes);
+            *pendingFilePtr = pendingFile->nextPendingFile;
+            transfer->nbrPendingFiles--;
+            free(pendingFile->temporaryPath);
+            free(pendingFile->path);
+            free(pendingFile);
+        }
+        // still in non-blocking mode, the disconnection doesn't wait for the device
+        disconnectRemoteSSH(&host->remote);
+        host->connected = 0;
+        host->laggingHandle = NULL;
+        free(host->laggingPath);
+        host->laggingPath = NULL;
+    }
+}
+
+// the checkpoint of a file of the SSH remote device failed: it was counted as done when it was closed
+static void failFanoutHostFile(fanoutHost_t *host, long long nbrBytes){
+    host->nbrFiles--;
+    host->nbrBytes -= nbrBytes;
+    host->nbrFailedFiles++;
+}
+
+// upload one file to all the connected SSH remote devices, the file is read once. return 0 if all the devices got the file
+static int fanoutUploadFile(sftpTransfer_t *transfer, char *fileFullPath, char *destination, long long size){
+    logTransfer(transfer, "file source => %s\n", fileFullPath);
+    FILE *file_dp;
+    if(isStandardStreamPath(fileFullPath)){
+        file_dp = transfer->dataInput;
+#ifdef WIN32
+        // read the data input as binary data, not as text
+        _setmode(_fileno(file_dp), _O_BINARY);
+#endif
+    }
+    else{
+        file_dp = fopen(fileFullPath, "rb");
+    }
+    if(file_dp==NULL){
+        logTransfer(transfer, "problem with file source %s!\n", fileFullPath);
+        transfer->runStats.nbrErrors++;
+        return -1;
+    }
+    // in batch durability mode the file is written with a temporary name
+    char *temporaryPath = getTemporaryPath(transfer, destination);
+    int nbrHostsInFile = 0;
+    int nbrHostsDone = 0;
+    long long nbrFailedFiles = 0; // failed files of all the devices before this file
+    int hostPos;
+    for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+        fanoutHost_t *host = &transfer->fanoutHosts[hostPos];
+        nbrFailedFiles += host->nbrFailedFiles;
+        if(!host->connected){
+            continue;
+        }
+        if(host->lagging){
+            logTransfer(transfer, "%s was dropped as too slow, file %s skipped\n", host->remote.ip, destination);
+            host->nbrFailedFiles++;
+            continue;
+        }
+        host->sftp_handle = libssh2_sftp_open(host->remote.sftp_session, temporaryPath, LIBSSH2_FXF_WRITE|LIBSSH2_FXF_CREAT|LIBSSH2_FXF_TRUNC, LIBSSH2_SFTP_S_IRWXU|LIBSSH2_SFTP_S_IRWXG|LIBSSH2_SFTP_S_IROTH);
+        if(host->sftp_handle==NULL){
+            logTransfer(transfer, "couldn't open or create file %s in %s! error code: %I32u\n", temporaryPath, host->remote.ip, libssh2_sftp_last_error(host->remote.sftp_session));
+            host->nbrFailedFiles++;
+            continue;
+        }
+        host->inFile = 1;
+        host->windowHead = 0;
+        host->windowLength = 0;
+        host->chunkOffset = 0;
+        host->fileBytes = 0;
+        host->lastProgressTime = getTime();
+        host->holdBackTime = 0;
+        libssh2_session_set_blocking(host->remote.session, 0);
+        nbrHostsInFile++;
+    }
+    sshRemote_t **remotes = (sshRemote_t**)malloc(transfer->nbrFanoutHosts*sizeof(sshRemote_t*));
+    int sourceEOF = 0;
+    long long totalRead = 0; // the progress is the data read, the slowest device is at most FANOUT_HOST_WINDOW blocks behind
+    double lastLoopTime = getTime();
+    while(nbrHostsInFile>0){
+        int progress = 0;
+        int nbrWaitingHosts = 0;
+        double now = getTime();
+        double loopTime = now-lastLoopTime;
+        lastLoopTime = now;
+        // read the next block once for all the devices, when all the devices have room in their window
+        if(!sourceEOF){
+            int windowFull = 0;
+            int hostIdle = 0;
+            for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+                if(transfer->fanoutHosts[hostPos].inFile && transfer->fanoutHosts[hostPos].windowLength==FANOUT_HOST_WINDOW){
+                    windowFull = 1;
+                }
+                else if(transfer->fanoutHosts[hostPos].inFile && transfer->fanoutHosts[hostPos].windowLength==0){
+                    hostIdle = 1;
+                }
+            }
+            // the devices with a full window hold back a device waiting for data, drop the ones that did it for too long
+            if(windowFull && hostIdle){
+                for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+                    fanoutHost_t *host = &transfer->fanoutHosts[hostPos];
+                    if(!host->inFile || host->windowLength!=FANOUT_HOST_WINDOW){
+                        continue;
+                    }
+                    host->holdBackTime += loopTime;
+                    if(host->holdBackTime>transfer->fanoutLagTimeout){
+                        logTransfer(transfer, "%s holds back the other devices, dropped from the fan-out of %s\n", host->remote.ip, destination);
+                        host->nbrDrops++;
+                        dropFanoutHost(transfer, host, temporaryPath, 1);
+                        nbrHostsInFile--;
+                        progress = 1;
+                    }
+                }
+            }
+            if(!windowFull){
+                fanoutChunk_t *chunk = (fanoutChunk_t*)malloc(sizeof(fanoutChunk_t));
+                chunk->length = fread(chunk->data, sizeof(char), TRANSFER_CHUNK_SIZE, file_dp);
+                if(chunk->length==0){
+                    if(ferror(file_dp)){
+                        logTransfer(transfer, "reading source file %s was failed!\n", fileFullPath);
+                        for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+                            if(transfer->fanoutHosts[hostPos].inFile){
+                                dropFanoutHost(transfer, &transfer->fanoutHosts[hostPos], temporaryPath, 0);
+                            }
+                        }
+                        nbrHostsInFile = 0;
+                    }
+                    sourceEOF = 1;
+                    free(chunk);
+                }
+                else{
+                    totalRead += chunk->length;
+                    reportProgress(transfer, fileFullPath, destination, totalRead, size);
+                    chunk->refCount = nbrHostsInFile;
+                    for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+                        fanoutHost_t *host = &transfer->fanoutHosts[hostPos];
+                        if(host->inFile){
+                            host->window[(host->windowHead+host->windowLength)%FANOUT_HOST_WINDOW] = chunk;
+                            host->windowLength++;
+                        }
+                    }
+                }
+                progress = 1;
+            }
+        }
+        // write the oldest block of each device
+        for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+            fanoutHost_t *host = &transfer->fanoutHosts[hostPos];
+            if(host->lagging){
+                // go on closing the file of the drop, without waiting for it
+                if(!finishLaggingFanoutHost(host)){
+                    remotes[nbrWaitingHosts++] = &host->remote;
+                }
+                continue;
+            }
+            if(!host->inFile){
+                continue;
+            }
+            if(host->windowLength==0){
+                // nothing to write, the device waits for the source: it's not stalled
+                host->lastProgressTime = getTime();
+                // this device has written the whole file
+                if(sourceEOF){
+                    libssh2_session_set_blocking(host->remote.session, 1);
+                    if(closeFileRemoteSSH(transfer, host->remote.sftp_session, host->sftp_handle, temporaryPath, destination, 0)==0){
+                        host->nbrFiles++;
+                        host->nbrBytes += host->fileBytes;
+                        nbrHostsDone++;
+                        // batch mode: the file waits for the checkpoint, a checkpoint failure is a failed file of this device
+                        if(transfer->durabilityMode==DURABILITY_BATCH){
+                            transfer->listPendingFile->fanoutHost = host;
+                            transfer->listPendingFile->nbrBytes = host->fileBytes;
+                        }
+                    }
+                    else{
+                        host->nbrFailedFiles++;
+                    }
+                    host->sftp_handle = NULL;
+                    host->inFile = 0;
+                    nbrHostsInFile--;
+                    progress = 1;
+                }
+                continue;
+            }
+            fanoutChunk_t *chunk = host->window[host->windowHead];
+            ssize_t nbrDataWritten = libssh2_sftp_write(host->sftp_handle, chunk->data+host->chunkOffset, chunk->length-host->chunkOffset);
+            if(nbrDataWritten>0){
+                host->chunkOffset += nbrDataWritten;
+                host->fileBytes += nbrDataWritten;
+                host->lastProgressTime = getTime();
+                if(host->chunkOffset==chunk->length){
+                    releaseFanoutChunk(host);
+                }
+                progress = 1;
+            }
+            else if(nbrDataWritten==LIBSSH2_ERROR_EAGAIN){
+                // stalled: it has blocks to write and nothing was written for a while, drop it from this file
+                if(getTime()-host->lastProgressTime>transfer->fanoutStallTimeout){
+                    logTransfer(transfer, "%s is too slow, dropped from the fan-out of %s\n", host->remote.ip, destination);
+                    host->nbrDrops++;
+                    dropFanoutHost(transfer, host, temporaryPath, 1);
+                    nbrHostsInFile--;
+                    progress = 1;
+                }
+                else{
+                    remotes[nbrWaitingHosts++] = &host->remote;
+                }
+            }
+            else{
+                logTransfer(transfer, "couldn't upload file %s to %s in %s! error code: %d\n", fileFullPath, destination, host->remote.ip, (int)nbrDataWritten);
+                dropFanoutHost(transfer, host, temporaryPath, 0);
+                nbrHostsInFile--;
+                progress = 1;
+            }
+        }
+        // no device could progress, wait for one of the sockets
+        if(!progress && nbrWaitingHosts>0){
+            waitSocketRemoteSSH(remotes, nbrWaitingHosts);
+        }
+    }
+    for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+        if(transfer->fanoutHosts[hostPos].connected && !transfer->fanoutHosts[hostPos].lagging){
+            libssh2_session_set_blocking(transfer->fanoutHosts[hostPos].remote.session, 1);
+        }
+    }
+    free(remotes);
+    free(temporaryPath);
+    if(file_dp!=transfer->dataInput){
+        fclose(file_dp);
+    }
+    // the run stats count the source once: a file done in at least one device, its bytes read. the bytes of each device are in its results
+    if(nbrHostsDone>0){
+        transfer->runStats.nbrFiles++;
+        transfer->runStats.nbrBytes += totalRead;
+    }
+    logTransfer(transfer, "fan-out of source file %s to destination %s file done.\n", fileFullPath, destination);
+    for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+        nbrFailedFiles -= transfer->fanoutHosts[hostPos].nbrFailedFiles;
+    }
+    return nbrFailedFiles==0 ? 0 : -1;
+}
+
+// create the destination from the original file in all the connected SSH remote devices (dedup mode). return 0 if it worked for all of them
+static int fanoutLinkFile(sftpTransfer_t *transfer, char *original, char *destination, long long size){
+    int error = 0;
+    int hostPos;
+    for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+        if(transfer->fanoutHosts[hostPos].connected && !transfer->fanoutHosts[hostPos].lagging && linkRemoteSSH(transfer, &transfer->fanoutHosts[hostPos].remote, original, destination)!=0){
+            error = -1;
+        }
+    }
+    if(error!=0){
+        return error;
+    }
+    int nbrHostsDone = 0;
+    for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+        if(transfer->fanoutHosts[hostPos].connected && transfer->fanoutHosts[hostPos].lagging){
+            logTransfer(transfer, "%s was dropped as too slow, file %s skipped\n", transfer->fanoutHosts[hostPos].remote.ip, destination);
+            transfer->fanoutHosts[hostPos].nbrFailedFiles++;
+        }
+        else if(transfer->fanoutHosts[hostPos].connected){
+            transfer->fanoutHosts[hostPos].nbrFiles++;
+            nbrHostsDone++;
+        }
+    }
+    if(nbrHostsDone>0){
+        transfer->runStats.nbrFiles++;
+        transfer->runStats.nbrDedupFiles++;
+        transfer->runStats.nbrDedupBytes += size;
+    }
+    return 0;
+}
+
+// create the directory in all the connected SSH remote devices. return 0 if it worked for all of them
+// (a lagging device is skipped, its directory fails without being a new error of the run)
+static int fanoutCreateDir(sftpTransfer_t *transfer, char *dir){
+    int error = 0;
+    int hostPos;
+    for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+        if(transfer->fanoutHosts[hostPos].connected && transfer->fanoutHosts[hostPos].lagging){
+            transfer->fanoutHosts[hostPos].nbrFailedDirectories++;
+        }
+        else if(transfer->fanoutHosts[hostPos].connected){
+            if(createDirInRemoteSSH(transfer, transfer->fanoutHosts[hostPos].remote.sftp_session, dir)==0){
+                transfer->fanoutHosts[hostPos].nbrDirectories++;
+            }
+            else{
+                transfer->fanoutHosts[hostPos].nbrFailedDirectories++;
+                error = -1;
+            }
+        }
+    }
+    return error;
+}
+
+// upload a file of the walk to all the SSH remote devices. in dedup mode, a content already uploaded is created from its first copy in all of them
+static int fanoutUploadSourcePath(sftpTransfer_t *transfer, sourcePath_t *sourcePath, char *destination){
+    dedupEntry_t *dedupEntry = findDedupEntry(transfer, sourcePath);
+    if(dedupEntry!=NULL && fanoutLinkFile(transfer, dedupEntry->remotePath, destination, sourcePath->size)==0){
+        return 0;
+    }
+    int hostPos;
+    for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+        if(transfer->fanoutHosts[hostPos].connected && !transfer->fanoutHosts[hostPos].lagging){
+            unlinkBeforeUploadRemoteSSH(transfer, transfer->fanoutHosts[hostPos].remote.sftp_session, destination);
+        }
+    }
+    int error = fanoutUploadFile(transfer, sourcePath->path, destination, sourcePath->size);
+    if(error==0){
+        addDedupEntry(transfer, sourcePath, destination);
+    }
+    return error;
+}
+
+// fan-out upload section: one walk of the source path for all the SSH remote devices
+static void fanoutUpload(sftpTransfer_t *transfer){
+    logTransfer(transfer, "start fan-out upload\n");
+    int hostPos;
+    // the standard input is streamed to the destination path, which is the full path of the file in the SSH remote servers
+    if(isStandardStreamPath(transfer->listSourcePath->path)){
+        for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+            if(transfer->fanoutHosts[hostPos].connected){
+                createParentDirInRemoteSSH(transfer, transfer->fanoutHosts[hostPos].remote.sftp_session, transfer->destinationPath);
+            }
+        }
+        int error = fanoutUploadFile(transfer, transfer->listSourcePath->path, transfer->destinationPath, -1);
+        finishLaggingFanoutHosts(transfer);
+        durabilityCheckpoint(transfer);
+        reportCompletion(transfer, transfer->listSourcePath->path, transfer->destinationPath, FILE_TYPE, error);
+        return;
+    }
+    // attempt to create the destination directory if not existe. a device where it fails keeps going, its files will fail
+    if(fanoutCreateDir(transfer, transfer->destinationPath)!=0){
+        logTransfer(transfer, "could create destination path in all the SSH remote devices\n");
+        transfer->runStats.nbrErrors++;
+    }
+    walkTransfer(transfer, 0, getUploadDestination, fanoutCreateDir, fanoutUploadSourcePath);
+    // the pending files of the lagging devices wait for this last checkpoint
+    finishLaggingFanoutHosts(transfer);
+    durabilityCheckpoint(transfer);
+}
+
+// the results of each SSH remote device are for one run, like the run stats
+static void resetFanoutResults(sftpTransfer_t *transfer){
+    int hostPos;
+    for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+        fanoutHost_t *host = &transfer->fanoutHosts[hostPos];
+        host->nbrFiles = 0;
+        host->nbrFailedFiles = 0;
+        host->nbrDirectories = 0;
+        host->nbrFailedDirectories = 0;
+        host->nbrBytes = 0;
+        host->nbrDrops = 0;
+    }
+}
+
+// print the results of each SSH remote device of the fan-out
+void printFanoutResults(sftpTransfer_t *transfer){
+    int hostPos;
+    logTransfer(transfer, "fan-out results:\n");
+    for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+        fanoutHost_t *host = &transfer->fanoutHosts[hostPos];
+        if(!host->connected && host->nbrDrops==0){
+            logTransfer(transfer, "    %s: not connected\n", host->remote.ip);
+            continue;
+        }
+        logTransfer(transfer, "    %s: %s, %lld files, %lld failed files (%lld too slow), %lld directories, %lld failed directories, %lld bytes\n", host->remote.ip, !host->connected ? "failed, disconnected" : (host->nbrFailedFiles==0 && host->nbrFailedDirectories==0) ? "ok" : "failed", host->nbrFiles, host->nbrFailedFiles, host->nbrDrops, host->nbrDirectories, host->nbrFailedDirectories, host->nbrBytes);
+    }
+}
+
+void cleanupTransfer(sftpTransfer_t *transfer){
+    freeListSourcePath(transfer);
+    free(transfer->destinationPath);
+    transfer->destinationPath = NULL;
+    while(transfer->listFilterRule!=NULL){
+        filterRule_t *rule = transfer->listFilterRule;
+        transfer->listFilterRule = rule->nextFilterRule;
+        free(rule->pattern);
+        free(rule);
+    }
+    transfer->nbrIncludeRules = 0;
+    freeFanoutHosts(transfer);
+}
+
+int connectTransfer(sftpTransfer_t *transfer){
+    // verify login options
+    if(verifyLogingOptions(transfer)!=0){
+        return -1;
+    }
+    transfer->remoteSyncSupported = 1;
+    // list of SSH remote devices for the fan-out upload: one walk and one read of the source for all the SSH remote devices
+    prepareFanoutHosts(transfer);
+    if(transfer->nbrFanoutHosts>1){
+        if((transfer->options&OPTION_RELAY_MASK)==OPTION_RELAY || (transfer->options&OPTION_ACTION_MASK)==OPTION_DOWNLOAD){
+            logTransfer(transfer, "a list of SSH remote devices works only for upload!\n");
+            freeFanoutHosts(transfer);
+            return -1;
+        }
+        if(connectFanoutHosts(transfer)==0){
+            freeFanoutHosts(transfer);
+            return -1;
+        }
+        return 0;
+    }
+    freeFanoutHosts(transfer);
+    // connect to the SSH remote device
+    if(connectRemoteSSH(transfer, &transfer->remoteSSH)!=0){
+        return -1;
+    }
+    transfer->sftp_session = transfer->remoteSSH.sftp_session;
+    // in relay mode connect to the second SSH remote device using the same connection and authentication logic
+    if((transfer->options&OPTION_RELAY_MASK)==OPTION_RELAY){
+        if(connectRemoteSSH(transfer, &transfer->relaySSH)!=0){
+            disconnectRemoteSSH(&transfer->remoteSSH);
+            transfer->sftp_session = NULL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int runTransfer(sftpTransfer_t *transfer){
+    memset(&transfer->runStats, 0, sizeof(runStats_t));
+    transfer->runStats.startTime = getTime();
+    transfer->runStats.firstFileTime = -1;
+    transfer->runStats.predictedTime = -1;
+    transfer->runStats.predictionTime = -1;
+    resetFanoutResults(transfer);
+    if(transfer->listSourcePath==NULL){
+        logTransfer(transfer, "no source path!\n");
+        return -1;
+    }
+    // verify transfer options
+    if(verifyTransferOptions(transfer)!=0){
+        return -1;
+    }
+    // the dedup table only lives for one run, the files of the SSH remote device could change between two runs
+    if(transfer->dedupMode!=DEDUP_NONE){
+        transfer->dedupTable = (struct dedupEntry_struct**)calloc(DEDUP_TABLE_SIZE, sizeof(struct dedupEntry_struct*));
+    }
+    long long nbrFailedFiles = 0;
+    int hostPos;
+    // start relay/upload/download
+    if(transfer->nbrFanoutHosts>1){
+        fanoutUpload(transfer);
+        for(hostPos=0; hostPos<transfer->nbrFanoutHosts; hostPos++){
+            nbrFailedFiles += transfer->fanoutHosts[hostPos].nbrFailedFiles;
+        }
+    }
+    else if((transfer->options&OPTION_RELAY_MASK) == OPTION_RELAY){
+        relay(transfer);
+    }
+    else if((transfer->options&OPTION_ACTION_MASK) == OPTION_UPLOAD){
+        upload(transfer);
+    }
+    else if((transfer->options&OPTION_ACTION_MASK) == OPTION_DOWNLOAD){
+        download(transfer);
+    }
+    freeDedupTable(transfer);
+    return (transfer->runStats.nbrErrors==0 && nbrFailedFiles==0) ? 0 : -1;
+}
+
+void disconnectTransfer(sftpTransfer_t *transfer){
+    disconnectFanoutHosts(transfer);
+    disconnectRemoteSSH(&transfer->relaySSH);
+    disconnectRemoteSSH(&transfer->remoteSSH);
+    transfer->sftp_session = NULL;
+}
@@ -0,0 +1,235 @@
+/****
+ *
+ * SFTP transfer library: upload, download, relay and fan-out of files and directories between the SSH client device and SSH remote devices.
+ * all the state of a transfer lives in its context (sftpTransfer_t), so several independent transfers can run in the same process,
+ * one thread per context (a context must not be used by two threads at the same time).
+ *
+ * how to use:
+ * 1. initTransferLibrary() once in the process, before any thread starts a transfer (libssh2 and winsock global initialization)
+ * 2. initTransfer(&transfer) then set the settings of the context: transfer.remoteSSH (ip, port, credentials), transfer.options,
+ *    durability, dedup, schedule, filters (addFilterRule), callbacks and user data
+ * 3. connectTransfer(&transfer) to open the SSH and SFTP sessions
+ * 4. setTransferPaths(&transfer, source, destination) then runTransfer(&transfer), as many times as needed on the same connection
+ * 5. disconnectTransfer(&transfer) and cleanupTransfer(&transfer)
+ * 6. exitTransferLibrary() once, when all the transfers are done
+ *
+*****/
+
+#ifndef SFTP_TRANSFER_H
+#define SFTP_TRANSFER_H
+
+#include <libssh2.h>
+#include <libssh2_sftp.h>
+#include <stdio.h>
+#ifdef WIN32
+#include <winsock2.h>
+#else
+#include <netinet/in.h>
+#endif
+
+/*
+ * enum represent all options in 5 bits
+ * bit 0 for the action (0 for upload or 1 for download)
+ * bit 1 and 2 for authentication method (00 for password and 01 for public/private key, 10 and 11 reserved for future use). the authentication method is saved per SSH remote device (sshRemote_t)
+ * bit 3 for recursivity (sub directories works only for directory)
+ * bit 4 for relay mode (transfer from the SSH remote device to a second SSH remote device, the action bit is ignored)
+ */
+enum{
+    OPTION_ACTION_MASK = 0b00001,
+    OPTION_AUTH_MASK = 0b00110,
+    OPTION_REC_MASK = 0b01000,
+    OPTION_RELAY_MASK = 0b10000,
+    OPTION_UPLOAD=0b00000,
+    OPTION_DOWNLOAD=0b00001,
+    OPTION_AUTH_PUBKEY=0b00000,
+    OPTION_AUTH_PASSWORD=0b00010,
+    OPTION_REC=0b01000,
+    OPTION_RELAY=0b10000
+};
+// durability modes (see SFTP_Transfer.c)
+enum{
+    DURABILITY_NONE=0,
+    DURABILITY_BATCH,
+    DURABILITY_STRICT
+};
+// dedup modes (see SFTP_Transfer.c)
+enum{
+    DEDUP_NONE=0,
+    DEDUP_HARDLINK,
+    DEDUP_SYMLINK,
+    DEDUP_REFLINK
+};
+// schedule policies, order of the files of a directory walk (see SFTP_Transfer.c)
+enum{
+    SCHEDULE_WALK=0,
+    SCHEDULE_LARGEST,
+    SCHEDULE_SMALLEST,
+    SCHEDULE_MIXED
+};
+enum{
+    DIRECTORY_TYPE=0b01,
+    FILE_TYPE=0b10,
+};
+enum{
+    FILTER_INCLUDE=0,
+    FILTER_EXCLUDE=1
+};
+#define DEFAULT_REMOTE_LISTERS 4
+#define MAX_REMOTE_LISTERS 64
+// seconds without progress before a slow SSH remote device is dropped from the fan-out of the current file
+#define DEFAULT_FANOUT_STALL_TIMEOUT 30
+// seconds a slow SSH remote device may hold back the others (its window is full while another one waits for data) during a file
+#define DEFAULT_FANOUT_LAG_TIMEOUT 5
+// entries of the walk read ahead to choose the next file (schedule policies other than walk)
+#define DEFAULT_SCHEDULE_WINDOW 256
+#define MAX_SCHEDULE_WINDOW 4096
+// "-" as source path (upload) means the data input, as destination path (download) means the data output
+#define STANDARD_STREAM_PATH "-"
+
+// everything we need to connect and talk to one SSH remote device
+typedef struct sshRemote_struct
+{
+    char *ip; //="192.168.1.110";
+    int port; // 22 is the default shh port
+    char *userName; //= "pi";
+    char *password; //= "raspberry"; // "shadow" (for the pub_key auth method)
+    char *publicKeyPath; //= "pub_rsa_key.pub";
+    char *privateKeyPath; //= "private_rsa_key";
+    int authMethod; // OPTION_AUTH_PASSWORD or OPTION_AUTH_PUBKEY
+#ifdef WIN32
+    SOCKET socket;
+#else
+    int socket;
+#endif
+    struct sockaddr_in sockaddr_in;
+    LIBSSH2_SESSION *session;
+    LIBSSH2_SFTP *sftp_session;
+}sshRemote_t;
+
+typedef struct sourcePath_struct
+{
+    char *path;
+    int type;
+    long long size; // -1 if unknown
+    unsigned long long hash; // content hash (dedup mode), valid if hashed is 1
+    int hashed;
+    struct sourcePath_struct *nextSourcePath;
+}sourcePath_t;
+
+typedef struct filterRule_struct
+{
+    char *pattern;
+    int type; // FILTER_INCLUDE or FILTER_EXCLUDE
+    int matchRelativePath; // the pattern has a separator, match it against the relative path instead of the name
+    int directoryOnly; // the pattern ended with a separator
+    struct filterRule_struct *nextFilterRule;
+}filterRule_t;
+
+// statistics of the last run of the transfer
+typedef struct runStats_struct
+{
+    double startTime;
+    long long nbrFiles;
+    long long nbrDirectories;
+    long long nbrErrors; // includes the files that failed at a durability checkpoint
+    long long nbrBytes;
+    long long nbrCheckpoints; // durability checkpoints (batch mode)
+    long long nbrSyncs; // fsync/syncfs calls, local and remote
+    double durabilityTime; // seconds spent to sync and rename files
+    long long nbrDedupFiles; // files created from a copy already uploaded (dedup mode)
+    long long nbrDedupBytes; // bytes not uploaded thanks to dedup
+    double firstFileTime; // seconds from the start to the first file done, -1 if none
+    double predictedTime; // completion time predicted from the first files (the entries listed at that time), -1 if no prediction
+    double predictionTime; // seconds from the start when the prediction was made
+    long long predictionListedFiles; // files listed by the walk when the prediction was made
+    int predictionWalkDone; // 1 if the walk was done, the prediction covers all the files
+}runStats_t;
+
+typedef struct sftpTransfer_struct sftpTransfer_t;
+// one line of message of the transfer (without the new line). without log callback the messages are printed to the standard output
+typedef void (*transferLogCallback_t)(sftpTransfer_t *transfer, const char *message, void *userData);
+// data of the current file written to the destination so far (totalBytes is -1 if the size is unknown, like a stream)
+typedef void (*transferProgressCallback_t)(sftpTransfer_t *transfer, const char *source, const char *destination, long long transferredBytes, long long totalBytes, void *userData);
+// a file or a directory of the transfer is done (error is 0 on success). in batch durability mode the file gets its name at the next checkpoint,
+// a file that fails at the checkpoint is counted in runStats.nbrErrors (runTransfer returns an error)
+typedef void (*transferCompletionCallback_t)(sftpTransfer_t *transfer, const char *source, const char *destination, int type, int error, void *userData);
+
+// context of one transfer: its settings, its connections and the state of its run
+struct sftpTransfer_struct
+{
+    // settings (initTransfer sets the defaults)
+    int options; // action, recursivity and relay mode (the authentication method is set per SSH remote device)
+    sshRemote_t remoteSSH; // source for download and relay, destination for upload. a list of ip (<ip1>,<ip2>,...) is a fan-out upload
+    sshRemote_t relaySSH; // the second SSH remote device, only used in relay mode as destination
+    sourcePath_t *listSourcePath; // source path (the paths under it come from the walk)
+    char *destinationPath;
+    int durabilityMode;
+    int dedupMode;
+    int nbrRemoteListers;
+    int fanoutStallTimeout;
+    int fanoutLagTimeout;
+    int schedulePolicy;
+    int scheduleWindow;
+    filterRule_t *listFilterRule;
+    int nbrIncludeRules;
+    long long filterMinSize; // -1 means no rule
+    long long filterMaxSize;
+    long long filterNewerThan; // seconds since epoch
+    long long filterOlderThan;
+    FILE *dataInput; // where the uploaded data comes from when the source path is "-" (standard input by default)
+    FILE *dataOutput; // where the downloaded data goes when the destination path is "-" (standard output by default)
+    // callbacks (NULL if not used), userData is passed back to them
+    transferLogCallback_t logCallback;
+    transferProgressCallback_t progressCallback;
+    transferCompletionCallback_t completionCallback;
+    void *userData;
+    char logLine[1024]; // message waiting for the end of its line (log callback)
+    int logLineLength;
+    // state of the connections and of the run, managed by the library
+    LIBSSH2_SFTP *sftp_session; // SFTP session of the SSH remote device (remoteSSH)
+    runStats_t runStats;
+    int remoteSyncSupported;
+    struct pendingFile_struct *listPendingFile;
+    int nbrPendingFiles;
+    struct dedupEntry_struct **dedupTable;
+    struct fanoutHost_struct *fanoutHosts;
+    int nbrFanoutHosts;
+};
+
+// global initialization of libssh2 (and winsock), once per process before any transfer. return 0 on success
+int initTransferLibrary();
+void exitTransferLibrary();
+
+// set the default settings of the transfer context
+void initTransfer(sftpTransfer_t *transfer);
+// free what the library allocated in the transfer context (source paths, destination path, filter rules, fan-out devices)
+void cleanupTransfer(sftpTransfer_t *transfer);
+
+// add new source path to the list of source path (a separator at the end is removed)
+void addPathToListSourcePath(sftpTransfer_t *transfer, char* sourcePath, int sourcePathType);
+// set the destination path (a separator at the end is removed)
+void setDestinationPath(sftpTransfer_t *transfer, char *path);
+// replace the source and destination paths, to run another transfer on the same connection
+void setTransferPaths(sftpTransfer_t *transfer, char *sourcePath, char *destinationPath);
+// add new filter rule (FILTER_INCLUDE or FILTER_EXCLUDE) to the list of filter rules
+void addFilterRule(sftpTransfer_t *transfer, char *pattern, int filterType);
+// parse size with an optional unit (K, M or G), return -1 if not valid
+long long parseFilterSize(char *sizeText);
+// parse date (YYYY-MM-DD, local time) or seconds since epoch, return -1 if not valid
+long long parseFilterTime(char *timeText);
+int isStandardStreamPath(char *path);
+
+// connect to the SSH remote device (and the relay SSH remote device, or all the fan-out SSH remote devices). return 0 on success
+int connectTransfer(sftpTransfer_t *transfer);
+// run the transfer of the source path to the destination path. return 0 if every file and directory was transferred
+int runTransfer(sftpTransfer_t *transfer);
+void disconnectTransfer(sftpTransfer_t *transfer);
+
+// print the statistics of the last run (through the log callback)
+void printRunStats(sftpTransfer_t *transfer);
+// print the results of each SSH remote device of the fan-out for the last run
+void printFanoutResults(sftpTransfer_t *transfer);
+// send a message to the log callback of the transfer, or print it
+void logTransfer(sftpTransfer_t *transfer, const char *format, ...);
+
+#endif